@@ -25,6 +25,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "perf.h"
 
 struct 
 {
@@ -70,6 +71,7 @@ static DiskBuffer* diskBufferGet(uint32_t dev, uint32_t sectorNumber)
 	{
 		if (b->Device == dev && b->SectorNumber == sectorNumber) 
 		{
+			perfCount(PERF_BUFFER_HITS);
 			b->ReferenceCount++;
 			spinlockRelease(&diskBufferCache.Lock);
 			sleeplockAcquire(&b->Lock);
@@ -82,6 +84,7 @@ static DiskBuffer* diskBufferGet(uint32_t dev, uint32_t sectorNumber)
 	{
 		if (b->ReferenceCount == 0 && (b->Flags & B_DIRTY) == 0) 
 		{
+			perfCount(PERF_BUFFER_MISSES);
 			b->Device = dev;
 			b->SectorNumber = sectorNumber;
 			b->Flags = 0;
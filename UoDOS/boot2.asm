@@ -24,12 +24,27 @@ ORG 9000h
 ; Kernel name (Must be a 8.3 filename and must be 11 bytes exactly)
 ImageName     db "KERNEL  SYS"
 
+; Initial ramdisk name (Must be a 8.3 filename and must be 11 bytes exactly)
+InitrdName    db "INITRD  CPI"
+
 ; This is where we will store the size of the kernel image in sectors (updated just before jump to kernel to be kernel size in bytes)
 KernelSize    dd 0
 
-; Used to store the number of the boot device
+; The kernel and initial ramdisk must fit below this address, clear of the stack at 90000h
+%define LOAD_LIMIT				80000h
+
+; Information passed to the kernel in EBX.  This must match BootInformation in bootinfo.h
 
-boot_device	  db  0				
+BootInformation:
+				dd 55D05B00h		; Magic number
+boot_device		dd 0				; Number of the boot device
+initrd_address	dd 0				; Physical address of the initial ramdisk (0 if there isn't one)
+initrd_size		dd 0				; Size of the initial ramdisk in bytes
+%ifdef MAX_PROCESSES
+				dd MAX_PROCESSES	; Maximum number of processes
+%else
+				dd 0				; Maximum number of processes (0 for the kernel's default)
+%endif
 
 ;	Start of the second stage of the boot loader
 	
@@ -65,10 +80,48 @@ Second_Stage:
 
 	mov		dword [KernelSize], ecx	; Save size of kernel (in sectors)
 	cmp		ax, 0					; Test for successful load
-	je		Switch_To_Protected_Mode
+	je		Load_Initrd
 
 	mov		si, msgFailure			; Unable to load kernel.sys - print error
 	call	Console_Write_16
+	jmp		Cannot_Continue
+
+;	Load the initial ramdisk (if there is one) straight after the kernel.  The kernel
+;	uses it where it is, so it must not go anywhere near the stack or the page tables.
+
+Load_Initrd:
+	movzx	eax, word [bpbBytesPerSector]	; Work out the segment just past the kernel
+	mul		dword [KernelSize]
+	shr		eax, 4
+	add		eax, KERNEL_RMODE_SEG
+	mov		ebx, eax
+	xor		ax, ax					; FindFile searches the root directory at 0000:2E00
+	mov		es, ax
+	call	LoadRootDirectory		; Loading the kernel overwrote it with the FAT
+	mov		si, InitrdName
+	call	FindFile
+	cmp		ax, -1
+	je		Switch_To_Protected_Mode	; No initial ramdisk
+	mov		ecx, dword [es:di + 1Ch]	; Size of the ramdisk from its directory entry
+	mov		eax, ebx
+	shl		eax, 4
+	mov		edx, eax
+	add		edx, ecx
+	cmp		edx, LOAD_LIMIT
+	ja		Initrd_Too_Big
+	mov		dword [initrd_address], eax
+	mov		dword [initrd_size], ecx
+	mov		bp, 0					; BX:BP points to memory address to load the file to
+	mov		si, InitrdName
+	call	LoadFile
+	cmp		ax, 0
+	je		Switch_To_Protected_Mode
+	mov		dword [initrd_address], 0	; Load failed, so boot without it
+
+Initrd_Too_Big:
+	mov		si, msgNoInitrd
+	call	Console_WriteLine_16
+	jmp		Switch_To_Protected_Mode
 	
 Cannot_Continue:	
 	mov		si, wait_for_key_msg
@@ -116,8 +169,20 @@ Initialise_PM:						; Start of main 32-bit code
 	
 	call 	EnablePaging
 	
-;	Copy kernel from load address to where it expects to be	
+;	If the kernel is compressed (see tools/lz4pack.c), decompress it to where it expects to be
+
+	mov		esi, KERNEL_PMODE_LOAD_ADDR
+	cmp		dword [esi], KERNEL_LZ4_MAGIC
+	jne		Copy_Kernel
+	mov		ecx, dword [esi + 8]	; ECX = Size of the compressed data after the 12 byte header
+	add		esi, 12
+	mov		edi, KERNEL_PMODE_BASE
+	call	Lz4Decompress
+	jmp		Run_Kernel
+
+;	Otherwise copy kernel from load address to where it expects to be	
 	
+Copy_Kernel:
   	mov		eax, dword [KernelSize]	; Calculate how many bytes we need to copy
   	movzx	ebx, word [bpbBytesPerSector]
   	mul		ebx
@@ -129,13 +194,16 @@ Initialise_PM:						; Start of main 32-bit code
 	mov		ecx, eax				; ECX = Number of dwords to copy
    	rep	movsd                   	; Copy kernel to its protected mode address
 
-	; Now we can execute our kernel
+Run_Kernel:
+	; Now we can execute our kernel, passing it the address of the boot information
 
+	mov		ebx, BootInformation
 	call	KERNEL_PMODE_BASE        
 	
 	
 %include "messages.asm"
 %include "gdt.asm"
 %include "paging.asm"
+%include "lz4.asm"
 
 	times 3584-($-$$) db 0	
\ No newline at end of file
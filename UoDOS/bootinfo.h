@@ -0,0 +1,16 @@
+// Information passed from the boot loader to the kernel.
+//
+// The second stage of the boot loader (boot2.asm) fills this in and passes its
+// physical address in EBX when it calls the kernel.  The layout must match
+// BootInformation in boot2.asm.
+
+#define BOOT_MAGIC		0x55D05B00
+
+struct _BootInformation
+{
+	uint32_t		Magic;				// BOOT_MAGIC
+	uint32_t		BootDevice;			// BIOS drive number we booted from
+	uint32_t		InitrdAddress;		// Physical address of the initial ramdisk, or 0
+	uint32_t		InitrdSize;			// Size of the initial ramdisk in bytes
+	uint32_t		MaxProcesses;		// Maximum number of processes, or 0 for NPROC
+};
@@ -224,7 +224,7 @@ struct
 
 void consoleInterrupt(int(*getc)(void))
 {
-	int c, doprocdump = 0;
+	int c, doprocdump = 0, dolockdump = 0;
 
 	spinlockAcquire(&cons.Lock);
 	while ((c = getc()) >= 0) 
@@ -235,6 +235,9 @@ void consoleInterrupt(int(*getc)(void))
 				// processDump() locks cons.Lock indirectly; invoke later
 				doprocdump = 1;
 				break;
+			case C('L'):  // Lock profile.
+				dolockdump = 1;
+				break;
 			case C('U'):  // Kill line.
 				while (input.e != input.w && input.buf[(input.e - 1) % INPUT_BUF] != '\n') 
 				{
@@ -270,6 +273,10 @@ void consoleInterrupt(int(*getc)(void))
 	{
 		processDump();  // now call processDump() wo. cons.Lock held
 	}
+	if (dolockdump)
+	{
+		lockProfileDump();
+	}
 }
 
 int consoleRead(File * f, char *dst, int n)
@@ -10,7 +10,19 @@ struct _Sleeplock;
 struct _Stat;
 struct _DirectoryEntry;
 struct _MountInfo;
+struct _FatNode;
+struct _TmpfsNode;
+struct _BootInformation;
 struct _Cpu;
+struct _Dirent;
+struct _Vnode;
+struct _Mount;
+struct _FileSystemOperations;
+struct _PerfCounters;
+struct _ReadWriteLock;
+struct _ThreadGroup;
+struct _Timer;
+struct _Timespec;
 
 typedef struct _DiskBuffer		DiskBuffer;
 typedef struct _Context			Context;
@@ -24,7 +36,19 @@ typedef struct _Sleeplock		Sleeplock;
 typedef struct _Stat			Stat;
 typedef struct _DirectoryEntry	DirectoryEntry;
 typedef struct _MountInfo		MountInfo;
+typedef struct _FatNode			FatNode;
+typedef struct _TmpfsNode		TmpfsNode;
+typedef struct _BootInformation	BootInformation;
 typedef struct _Cpu				Cpu;
+typedef struct _Dirent			Dirent;
+typedef struct _Vnode			Vnode;
+typedef struct _Mount			Mount;
+typedef struct _FileSystemOperations	FileSystemOperations;
+typedef struct _PerfCounters	PerfCounters;
+typedef struct _ReadWriteLock	ReadWriteLock;
+typedef struct _ThreadGroup		ThreadGroup;
+typedef struct _Timer			Timer;
+typedef struct _Timespec		Timespec;
 
 // bio.c
 void						diskBufferCacheInitialise(void);
@@ -38,6 +62,13 @@ void						cprintf(char*, ...);
 void						consoleInterrupt(int(*)(void));
 void						panic(char*) __attribute__((noreturn));
 
+// dirindex.c
+void						directoryIndexInitialise(void);
+int							directoryIndexLookup(uint32_t, uint32_t, const char *, DirectoryEntry *);
+int							directoryIndexBegin(uint32_t, uint32_t);
+void						directoryIndexEnd(uint32_t, uint32_t);
+void						directoryIndexAdd(uint32_t, uint32_t, DirectoryEntry *);
+
 // exec.c
 int							exec(char*, char**);
 
@@ -45,22 +76,31 @@ int							exec(char*, char**);
 File*						allocateFileStructure(void);
 void						fileClose(File*);
 File*						fileDup(File*);
+File*						fileGet(File**);
 void						filesInitialise(void);
 int							fileRead(File*, char*, int n);
+int							fileReadDirectory(File*, Dirent*, int);
 int							fileStat(File*, Stat*);
 int							fileWrite(File*, char*, int n);
 
 // fs.c
-void						fsFat12Initialise(void);
-uint32_t					fsFat12Read(File *, unsigned char *, unsigned int);
-void						fsFat12Close(File *);
-File	*					fsFat12Open(const char *, const char *, int);
+void						fsFatInitialise(void);
+extern FileSystemOperations	fsFatOperations;
+
+// futex.c
+void						futexInitialise(void);
+int							futexWait(int*, int);
+int							futexWake(int*, int);
 
 // ide.c
 void						ideInitialise(void);
 void						ideInterruptHandler(void);
 void						ideReadWrite(DiskBuffer*);
 
+// initrd.c
+void						initrdInitialise(BootInformation *);
+extern FileSystemOperations	initrdOperations;
+
 // ioApic.c
 void						ioApicEnable(int irq, int cpu);
 extern uint8_t				ioapicid;
@@ -81,13 +121,28 @@ int							localApicId(void);
 extern volatile uint32_t*	localApic;
 void						localApicEndOfInterrupt(void);
 void						localApicInitialise(void);
+void						localApicSendInterrupt(uint8_t, int);
+void						localApicSetTimer(uint32_t);
 void						localApicStartup(uint8_t, uint32_t);
+uint32_t					localApicTimerCount(void);
 void						microDelay(int);
 
+// lockprof.c
+void						lockProfileAcquire(int, uint64_t);
+void						lockProfileDump(void);
+int							lockProfileRegister(char*, int);
+void						lockProfileRelease(int, uint64_t);
+
 // mp.c
 extern int					ismp;
 void						mpinit(void);
 
+// perf.c
+void						perfCount(int);
+void						perfCountOn(int, int, uint32_t);
+void						perfCountSyscall(int);
+void						perfRead(PerfCounters*);
+
 // picirq.c
 void						picInitialise(void);
 
@@ -98,14 +153,18 @@ int							piperead(Pipe*, char*, int);
 int							pipewrite(Pipe*, char*, int);
 
 // Process.c
+void						beginSystemCall(void);
+int							clone(uint32_t, uint32_t, uint32_t);
 int							cpuId(void);
+void						endSystemCall(void);
 void						exit(void);
 int							fork(void);
 int							growProcess(int);
+int							join(int);
 int							kill(int);
 Cpu*						myCpu(void);
 Process*					myProcess();
-void						processTableInitialise(void);
+void						processTableInitialise(BootInformation*);
 void						processDump(void);
 void						scheduler(void) __attribute__((noreturn));
 void						sched(void);
@@ -113,8 +172,16 @@ void						sleep(void*, Spinlock*);
 void						initialiseFirstUserProcess(void);
 int							wait(void);
 void						wakeup(void*);
+int							wakeupCount(void*, int);
 void						yield(void);
 
+// rwlock.c
+void						readLockAcquire(ReadWriteLock*);
+void						readLockRelease(ReadWriteLock*);
+void						readWriteLockInitialise(ReadWriteLock*, char*);
+void						writeLockAcquire(ReadWriteLock*);
+void						writeLockRelease(ReadWriteLock*);
+
 // swtch.asm
 void						swtch(Context**, Context*);
 
@@ -144,6 +211,8 @@ char*						strncpy(char*, const char*, int);
 int							strcmp(const char*, const char*);
 char *						strcpy(char *, const char *);
 char*						strchr(char *, int);
+void						stringInitialise(void);
+void						stringSelfTest(void);
 
 // syscall.c
 int							argint(int, int*);
@@ -154,19 +223,46 @@ int							fetchstr(uint32_t, char**);
 void						syscall(void);
 
 // timer.c
-void						timerinit(void);
+int							clockGetTime(int, Timespec*);
+uint64_t					clockNanoseconds(void);
+uint32_t					clockTicks(void);
+void						timerIdle(void);
+void						timerInitialise(void);
+void						timerInterrupt(void);
+void						timerStart(void);
+int							timerSleep(uint64_t);
+
+// tmpfs.c
+void						tmpfsInitialise(void);
+extern FileSystemOperations	tmpfsOperations;
 
 // trap.c
 void						interruptDescriptorTableInitialise(void);
-extern uint32_t				ticks;
 void						trapVectorsInitialise(void);
-extern Spinlock				tickslock;
 
 // uart.c
 void						uartinit(void);
 void						uartintr(void);
 void						uartputc(int);
 
+// vfs.c
+void						vfsInitialise(void);
+int							vfsMount(const char *, FileSystemOperations *, uint32_t);
+Vnode*						vfsLookup(const char *, const char *);
+File*						vfsOpen(const char *, const char *, int);
+File*						vfsCreate(const char *, const char *);
+int							vfsMakeDirectory(const char *, const char *);
+int							vfsRemove(const char *, const char *);
+int							vfsTruncate(File *, uint32_t);
+int							vfsRead(File *, char *, int);
+int							vfsWrite(File *, char *, int);
+int							vfsReadDirectory(File *, Dirent *, int);
+int							vfsStat(File *, Stat *);
+void						vfsClose(File *);
+Vnode*						vnodeGet(Mount *, uint32_t, Vnode *);
+Vnode*						vnodeDup(Vnode *);
+void						vnodePut(Vnode *);
+
 // vm.c
 void						initialiseGDT(void);
 void						allocateKernelVirtualMemory(void);
@@ -182,6 +278,8 @@ void						switchToUserVirtualMemory(Process*);
 void						switchToKernelVirtualMemory(void);
 int							copyToUserVirtualMemory(pde_t*, uint32_t, void*, uint32_t);
 void						clearPTEU(pde_t *pgdir, char *uva);
+void						tlbFlushInterrupt(void);
+void						tlbShootdown(pde_t*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -0,0 +1,13 @@
+// A decoded directory entry, as returned by the getdents system call
+
+#define DIRENTNAMESIZE 13  // "NAME.EXT" plus terminating NUL
+
+struct _Dirent
+{
+  char		name[DIRENTNAMESIZE];	// File name in 8.3 form
+  uint8_t	attrib;					// FAT attribute byte
+  short		type;					// T_DIR or T_FILE (see stat.h)
+  uint32_t	ino;					// Inode number (first cluster of the file)
+  uint32_t	size;					// Size of file in bytes
+  uint32_t	mtime;					// Time of last modification (DOS format, see stat.h)
+};
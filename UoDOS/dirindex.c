@@ -0,0 +1,274 @@
+// Directory hash index.
+//
+// Looking a name up in a FAT directory means reading every 32-byte entry
+// until we find it.  To avoid doing that on every open and exec, the first
+// lookup in a directory builds an in-memory hash table of its entries and
+// later lookups use that.  Indexes are keyed on the disk device and the first
+// cluster of the directory (0 for the root directory) and are held in pages
+// from kalloc.c.
+// Only NDIRINDEX directories are indexed at a time; the least recently used
+// index is thrown away when another one is needed.  A directory with too
+// many entries for DIRINDEX_PAGES keeps its slot, marked as too big, so that
+// lookups go straight to a scan instead of building the index again.
+//
+// Interface:
+// * directoryIndexLookup returns DIRINDEX_FOUND or DIRINDEX_NOT_FOUND for an
+//   indexed directory, or DIRINDEX_NOT_INDEXED if the caller must scan it.
+// * To build an index, call directoryIndexBegin.  If it returns 1, add every
+//   entry with directoryIndexAdd and then call directoryIndexEnd.
+// * Nothing keeps an index current as a directory changes.  FAT is mounted
+//   read-only, so its directories never do; a FAT that can be written must
+//   update or throw away the index wherever it changes a directory entry.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "fs.h"
+
+#define DIRINDEX_PAGES		16		// Maximum pages of entries per index
+#define DIRINDEX_BUCKETS	128		// Hash buckets per index (must be a power of 2)
+
+#define INDEX_FREE			0
+#define INDEX_BUILDING		1
+#define INDEX_COMPLETE		2
+#define INDEX_TOO_BIG		3			// Has no entries; the directory must be scanned
+
+typedef struct _DirectoryIndexNode
+{
+	DirectoryEntry					Entry;
+	struct _DirectoryIndexNode *	Next;
+} DirectoryIndexNode;
+
+#define NODES_PER_PAGE		(PGSIZE / sizeof(DirectoryIndexNode))
+
+typedef struct _DirectoryIndex
+{
+	int						State;
+	uint32_t				Device;
+	uint32_t				DirectoryCluster;
+	uint32_t				LastUsed;
+	uint32_t				NodeCount;			// Nodes handed out from Pages
+	uint32_t				PageCount;
+	char *					Pages[DIRINDEX_PAGES];
+	DirectoryIndexNode *	Buckets[DIRINDEX_BUCKETS];
+} DirectoryIndex;
+
+struct
+{
+	Spinlock			Lock;
+	uint32_t			Clock;
+	DirectoryIndex		Index[NDIRINDEX];
+} directoryIndexCache;
+
+void directoryIndexInitialise(void)
+{
+	spinlockInitialise(&directoryIndexCache.Lock, "directoryIndex");
+}
+
+// FNV-1a hash of a packed 11 character 8.3 name
+
+static uint32_t directoryIndexHash(const uint8_t * name)
+{
+	uint32_t hash = 2166136261u;
+
+	for (int i = 0; i < 11; i++)
+	{
+		hash = (hash ^ name[i]) * 16777619u;
+	}
+	return hash & (DIRINDEX_BUCKETS - 1);
+}
+
+// Free the pages held by an index and mark it free.  Caller must hold the lock.
+
+static void directoryIndexFree(DirectoryIndex * index)
+{
+	for (uint32_t i = 0; i < index->PageCount; i++)
+	{
+		freePhysicalMemoryPage(index->Pages[i]);
+	}
+	memset(index, 0, sizeof(DirectoryIndex));
+}
+
+// Free the entries of an index that has outgrown DIRINDEX_PAGES but keep
+// its slot, so the directory is not indexed again.  Caller must hold the lock.
+
+static void directoryIndexMarkTooBig(DirectoryIndex * index)
+{
+	uint32_t device = index->Device;
+	uint32_t directoryCluster = index->DirectoryCluster;
+	uint32_t lastUsed = index->LastUsed;
+
+	directoryIndexFree(index);
+	index->State = INDEX_TOO_BIG;
+	index->Device = device;
+	index->DirectoryCluster = directoryCluster;
+	index->LastUsed = lastUsed;
+}
+
+// Find the index for a directory.  Caller must hold the lock.
+
+static DirectoryIndex * directoryIndexFind(uint32_t device, uint32_t directoryCluster)
+{
+	DirectoryIndex * index;
+
+	for (index = directoryIndexCache.Index; index < &directoryIndexCache.Index[NDIRINDEX]; index++)
+	{
+		if (index->State != INDEX_FREE && index->Device == device && index->DirectoryCluster == directoryCluster)
+		{
+			return index;
+		}
+	}
+	return 0;
+}
+
+// Return the node holding a name, or 0.  Caller must hold the lock.
+
+static DirectoryIndexNode * directoryIndexFindNode(DirectoryIndex * index, const char * dosFileName)
+{
+	DirectoryIndexNode * p = index->Buckets[directoryIndexHash((const uint8_t *)dosFileName)];
+
+	for (; p; p = p->Next)
+	{
+		if (memcmp(p->Entry.Filename, dosFileName, 11) == 0)
+		{
+			return p;
+		}
+	}
+	return 0;
+}
+
+int directoryIndexLookup(uint32_t device, uint32_t directoryCluster, const char * dosFileName, DirectoryEntry * foundDirectoryEntry)
+{
+	DirectoryIndex * index;
+	DirectoryIndexNode * node;
+	int result = DIRINDEX_NOT_INDEXED;
+
+	spinlockAcquire(&directoryIndexCache.Lock);
+	index = directoryIndexFind(device, directoryCluster);
+	if (index && index->State == INDEX_TOO_BIG)
+	{
+		index->LastUsed = ++directoryIndexCache.Clock;
+	}
+	else if (index && index->State == INDEX_COMPLETE)
+	{
+		index->LastUsed = ++directoryIndexCache.Clock;
+		node = directoryIndexFindNode(index, dosFileName);
+		if (node)
+		{
+			memmove(foundDirectoryEntry, &node->Entry, sizeof(DirectoryEntry));
+			result = DIRINDEX_FOUND;
+		}
+		else
+		{
+			result = DIRINDEX_NOT_FOUND;
+		}
+	}
+	spinlockRelease(&directoryIndexCache.Lock);
+	return result;
+}
+
+// Claim an index slot for a directory.  Returns 1 if the caller should now
+// add the directory's entries, or 0 if it is already indexed, being
+// indexed by someone else or known to be too big to index.
+
+int directoryIndexBegin(uint32_t device, uint32_t directoryCluster)
+{
+	DirectoryIndex * index;
+	DirectoryIndex * victim = 0;
+
+	spinlockAcquire(&directoryIndexCache.Lock);
+	if (directoryIndexFind(device, directoryCluster))
+	{
+		spinlockRelease(&directoryIndexCache.Lock);
+		return 0;
+	}
+	for (index = directoryIndexCache.Index; index < &directoryIndexCache.Index[NDIRINDEX]; index++)
+	{
+		if (index->State == INDEX_FREE)
+		{
+			victim = index;
+			break;
+		}
+		if ((index->State == INDEX_COMPLETE || index->State == INDEX_TOO_BIG) && (victim == 0 || index->LastUsed < victim->LastUsed))
+		{
+			victim = index;
+		}
+	}
+	if (victim == 0)
+	{
+		spinlockRelease(&directoryIndexCache.Lock);
+		return 0;
+	}
+	directoryIndexFree(victim);
+	victim->State = INDEX_BUILDING;
+	victim->Device = device;
+	victim->DirectoryCluster = directoryCluster;
+	victim->LastUsed = ++directoryIndexCache.Clock;
+	spinlockRelease(&directoryIndexCache.Lock);
+	return 1;
+}
+
+// Mark a directory's index as ready for lookups
+
+void directoryIndexEnd(uint32_t device, uint32_t directoryCluster)
+{
+	DirectoryIndex * index;
+
+	spinlockAcquire(&directoryIndexCache.Lock);
+	index = directoryIndexFind(device, directoryCluster);
+	if (index && index->State == INDEX_BUILDING)
+	{
+		index->State = INDEX_COMPLETE;
+	}
+	spinlockRelease(&directoryIndexCache.Lock);
+}
+
+// Add or update an entry in a directory's index.  Does nothing if the
+// directory is not indexed.  If the index is full, its entries are freed
+// and it is marked too big, so the directory goes back to being scanned.
+// If a page cannot be allocated, the index is just discarded.
+
+void directoryIndexAdd(uint32_t device, uint32_t directoryCluster, DirectoryEntry * directoryEntry)
+{
+	DirectoryIndex * index;
+	DirectoryIndexNode * node;
+	DirectoryIndexNode ** bucket;
+	char * page;
+
+	spinlockAcquire(&directoryIndexCache.Lock);
+	index = directoryIndexFind(device, directoryCluster);
+	if (index == 0 || index->State == INDEX_TOO_BIG)
+	{
+		spinlockRelease(&directoryIndexCache.Lock);
+		return;
+	}
+	node = directoryIndexFindNode(index, (const char *)directoryEntry->Filename);
+	if (node == 0)
+	{
+		if (index->NodeCount == index->PageCount * NODES_PER_PAGE)
+		{
+			if (index->PageCount == DIRINDEX_PAGES)
+			{
+				directoryIndexMarkTooBig(index);
+				spinlockRelease(&directoryIndexCache.Lock);
+				return;
+			}
+			if ((page = allocatePhysicalMemoryPage()) == 0)
+			{
+				directoryIndexFree(index);
+				spinlockRelease(&directoryIndexCache.Lock);
+				return;
+			}
+			index->Pages[index->PageCount++] = page;
+		}
+		node = (DirectoryIndexNode *)index->Pages[index->NodeCount / NODES_PER_PAGE] + index->NodeCount % NODES_PER_PAGE;
+		index->NodeCount++;
+		bucket = &index->Buckets[directoryIndexHash(directoryEntry->Filename)];
+		node->Next = *bucket;
+		*bucket = node;
+	}
+	memmove(&node->Entry, directoryEntry, sizeof(DirectoryEntry));
+	spinlockRelease(&directoryIndexCache.Lock);
+}
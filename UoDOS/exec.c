@@ -6,6 +6,7 @@
 #include "proc.h"
 #include "defs.h"
 #include "x86.h"
+#include "spinlock.h"
 #include "fs.h"
 #include "file.h"
 #include "pe.h"
@@ -34,7 +35,13 @@ int exec(char *path, char **argv)
  	Process *curproc = myProcess();
 	int oldFilePosition;
 		
-	File * exeFile = fsFat12Open(curproc->Cwd, path, 0);
+	// Other threads would be left running in the old image, or would free it
+	// when they were reaped.  They must all have exited and been joined.
+	if (curproc->Group->ReferenceCount > 1)
+	{
+		return -1;
+	}
+	File * exeFile = vfsOpen(curproc->Cwd, path, 0);
 	if (!exeFile)
 	{
 		return -1;
@@ -145,7 +152,8 @@ int exec(char *path, char **argv)
 	// Commit to the user image.
 	oldpgdir = curproc->PageTable;
 	curproc->PageTable = pgdir;
-	curproc->MemorySize = memorySize;
+	curproc->Group->MemorySize = memorySize;
+	curproc->Group->MappedSize = memorySize;
 	curproc->Trapframe->eip = imageFileHeader.OptionalHeader.AddressOfEntryPoint;
 	curproc->Trapframe->esp = sp;
     switchToUserVirtualMemory(curproc);
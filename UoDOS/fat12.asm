@@ -148,59 +148,68 @@ LoadFile_Start:
 	call	LoadFAT							; Load the FAT into memory
 
 LoadFile_Load:
-	; Load the cluster
-	mov		ax, word [cluster]				; Cluster to read
-	pop		es								 
-	pop		bx
+	; Find the run of consecutive clusters starting at this one, so that they
+	; can all be read at once
+	mov		ax, word [cluster]
+	xor		si, si							; SI = Number of clusters in the run
+
+LoadFile_Run:
+	inc		si
+	call	GetNextCluster					; DX = Cluster following AX in the chain
+	inc		ax
+	cmp		dx, ax							; Is it the next one on the disk?
+	je		LoadFile_Run
+	push	dx								; Save the cluster following the run
+
+	; Load the run of clusters
+	mov		ax, word [cluster]
 	call	ClusterToLBA					; Convert cluster number to logical sector number
-	movzx   cx, byte [bpbSectorsPerCluster]	; We will read one cluster of sectors
-
+	push	ax
+	movzx	ax, byte [bpbSectorsPerCluster]
+	mul		si
+	mov		cx, ax							; CX = Number of sectors in the run
+	pop		ax
+	pop		word [cluster]					; The next cluster to load
+	pop		es
+	pop		bx
+	pop		dx								; Update the number of sectors to return
+	add		dx, cx
+	push	dx
 	call	ReadSectors
-	pop		cx
-	movzx	ax, byte [bpbSectorsPerCluster]										; Update the number of sectors to return 
-	add		cx, ax
-	push	cx
-
 	push	bx
 	push	es
-	mov		ax, FAT_SEG						; Get the next cluster from the FAT
-	mov		es, ax
-	xor		bx, bx
+	cmp		word [cluster], 0FF0h			; Test for end of file
+	jb		LoadFile_Load
 
-	; get next cluster
+	pop		es
+	pop		bx
+	pop		cx
+	xor		ax, ax
+	ret
 
-	mov     ax, word [cluster]				; Get current cluster
-	mov     cx, ax							
-	mov     dx, ax							
-	shr     dx, 1							; Divide by two
-	add     cx, dx							; And add to give us a mulitply by 3/2
+;  Get the next cluster in a chain from the FAT (which must have been loaded by LoadFAT)
+;
+;  Input:  AX = Cluster number
+;  Output: DX = Next cluster number (0FF0h or above at the end of the chain)
 
-	mov		bx, 0							; Location of fat in memory
-	add		bx, cx
+GetNextCluster:
+	push	bx
+	push	es
+	push	word FAT_SEG
+	pop		es
+	mov		bx, ax							; Offset of entry in FAT = cluster * 3 / 2
+	shr		bx, 1
+	add		bx, ax
 	mov		dx, word [es:bx]
 	test	ax, 1							; Test for odd or even cluster
-	jnz		Odd_Cluster
-
-Even_Cluster:
+	jnz		GetNextCluster_Odd
 	and		dx, 0000111111111111b			; Take low 12 bits
-	jmp		LoadFile_Done
+	jmp		GetNextCluster_Done
 
-Odd_Cluster:
+GetNextCluster_Odd:
 	shr		dx, 4							; Take high 12 bits
 
-LoadFile_Done:
-	mov		word [cluster], dx
-	cmp		dx, 0FF0h						; Test for end of file 
-	jb		LoadFile_Load
-
+GetNextCluster_Done:
 	pop		es
 	pop		bx
-	pop		cx
-	xor		ax, ax
 	ret
-
-
-
-
-
-
@@ -1,10 +1,12 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
-#include "fs.h"
+#include "stat.h"
 #include "spinlock.h"
+#include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "vfs.h"
 
 Device devices[NDEV];
 
@@ -59,6 +61,24 @@ File* fileDup(File *f)
 	return f;
 }
 
+// Take a reference to the file in a descriptor slot, or return 0 if the
+// slot is empty.  The threads of a process share their descriptors, so the
+// slot is read under the lock: a slot is always cleared before the reference
+// it held is dropped, so a file found there cannot have been closed yet.
+File* fileGet(File **slot)
+{
+	File *f;
+
+	spinlockAcquire(&FileTable.Lock);
+	f = *slot;
+	if (f)
+	{
+		f->ReferenceCount++;
+	}
+	spinlockRelease(&FileTable.Lock);
+	return f;
+}
+
 // Close file f.  (Decrement ref count, close when reaches 0.)
 void fileClose(File *f)
 {
@@ -85,7 +105,7 @@ void fileClose(File *f)
 	}
 	else if (ff.Type == FD_FILE || ff.Type == FD_DIR) 
 	{
-		fsFat12Close(&ff);
+		vfsClose(&ff);
 	}
 
 }
@@ -95,14 +115,29 @@ int fileStat(File *f, Stat *st)
 {
 	if (f->Type == FD_FILE || f->Type == FD_DIR) 
 	{
-		//    ilock(f->ip);
-		//    stati(f->ip, st);
-		//    iunlock(f->ip);
+		return vfsStat(f, st);
+	}
+	if (f->Type == FD_DEVICE)
+	{
+		memset(st, 0, sizeof(Stat));
+		st->type = T_DEV;
+		st->dev = f->DeviceID;
+		st->nlink = 1;
 		return 0;
 	}
 	return -1;
 }
 
+// Read up to count decoded entries from directory f.
+int fileReadDirectory(File *f, Dirent *dirents, int count)
+{
+	if (f->Readable == 0 || f->Type != FD_DIR)
+	{
+		return -1;
+	}
+	return vfsReadDirectory(f, dirents, count);
+}
+
 // Read from file f.
 int fileRead(File *f, char *addr, int n)
 {
@@ -122,7 +157,7 @@ int fileRead(File *f, char *addr, int n)
 	}
 	else if (f->Type == FD_FILE || f->Type == FD_DIR)
 	{
-		r = fsFat12Read(f, (unsigned char *)addr, n);
+		r = vfsRead(f, addr, n);
 		return r;
 	}
 	panic("fileRead");
@@ -144,7 +179,10 @@ int fileWrite(File *f, char *addr, int n)
 	{
 		return pipewrite(f->Pipe, addr, n);
 	}
-	// Code to write to a disk file needs to be added
+	else if (f->Type == FD_FILE)
+	{
+		return vfsWrite(f, addr, n);
+	}
 	panic("fileWrite");
 }
 
@@ -14,11 +14,9 @@ struct _File
   char					 Readable;
   char					 Writable;
   Pipe *				 Pipe;
-  DirectoryEntry		 DirectoryEntry;
+  Vnode *				 Vnode;
   char					 Name[256];
-  uint32_t				 Eof;
   uint32_t				 Position;
-  uint32_t				 Size;
   uint32_t				 DeviceID;
 };
 
@@ -7,6 +7,18 @@ absoluteSector 			db 0x00
 absoluteHead   			db 0x00
 absoluteTrack  			db 0x00
 
+diskExtensions			db 0FFh				; 1 if the INT 13h extensions are supported, 0 if not, 0FFh if not checked yet
+
+; Disk address packet for INT 13h AH=42h
+
+diskAddressPacket		db 10h				; Size of packet
+						db 0
+dapSectorCount			dw 0				; Number of sectors to read
+dapOffset				dw 0				; Buffer to read to
+dapSegment				dw 0
+dapSector				dw 0				; Starting sector (LBA)
+						dw 0, 0, 0
+
 ; Convert Cluster number to Linear-Block-Addressing (LBA)
 ;
 ; LBA = First data sector + (cluster - 2) * sectors per cluster
@@ -40,45 +52,146 @@ LBAToCHS:
 	mov     ch, al
 	ret
 
-; Read a series of sectors from disk.  If a sector read fails, it will
-; be attempted a total of five times. 
-; 
+; Check whether the BIOS supports the INT 13h extensions (LBA disk address
+; packets) for the boot drive and record the result in diskExtensions.
+
+CheckExtensions:
+	pusha
+	mov		byte [diskExtensions], 0
+	mov		ah, 41h								; BIOS installation check for the extensions
+	mov		bx, 55AAh
+	mov		dl, byte [bsDriveNumber]
+	int		13h
+	jc		CheckExtensions_Done				; Extensions are not supported
+	cmp		bx, 0AA55h
+	jne		CheckExtensions_Done
+	test	cl, 1								; Bit 0 is set if disk address packets are supported
+	jz		CheckExtensions_Done
+	mov		byte [diskExtensions], 1
+
+CheckExtensions_Done:
+	popa
+	ret
+
+; Read a series of sectors from disk.  As many sectors as possible are read
+; with each BIOS call, using the INT 13h extensions if the BIOS supports them
+; and a track at a time if not.  If a read fails, it will be attempted a
+; total of five times.
+;
 ; On input:
 ; 	CX = 	  Number of sectors to read
 ; 	AX =	  Starting sector
 ;   ES:BX => Buffer to read to
+;
+; On output:
+;	AX =	  Sector after the last one read
+;   ES:BX => Byte after the last one read
 
 ReadSectors:
-	mov     di, 5                          		  ; We attempt each read 5 times if an error occurs
+	push	dx
+	push	si
+	push	di
+	push	bp
+	cmp		byte [diskExtensions], 0FFh			; Have we checked for the extensions yet?
+	jne		ReadSectors_Next
+	call	CheckExtensions
+
+ReadSectors_Next:
+	jcxz	ReadSectors_Done
+
+	; Normalise ES:BX so that BX is less than 16.  The buffer offset then cannot
+	; wrap during a read of up to 127 sectors.
+
+	mov		dx, bx
+	shr		dx, 4
+	mov		si, es
+	add		si, dx
+	mov		es, si
+	and		bx, 0Fh
+
+	; DI = Number of sectors to read with this call.  This is at most 127 (the most
+	; some BIOSes will read at once) and must not cross a 64KB boundary in memory,
+	; since the DMA controller cannot handle that.
+
+	mov		di, 127
+	cmp		cx, di
+	jae		ReadSectors_Boundary
+	mov		di, cx
+
+ReadSectors_Boundary:
+	mov		dx, es
+	shl		dx, 4
+	add		dx, bx
+	neg		dx									; DX = Bytes to the next 64KB boundary (0 means 64KB)
+	jz		ReadSectors_Start
+	shr		dx, 9								; Sectors to the next 64KB boundary
+	jnz		ReadSectors_Limit
+	inc		dx									; Buffer is not sector aligned, so read one sector at a time
+
+ReadSectors_Limit:
+	cmp		di, dx
+	jbe		ReadSectors_Start
+	mov		di, dx
+
+ReadSectors_Start:
+	mov     bp, 5                          		; We attempt each read 5 times if an error occurs
 
 AttemptRead:
 	push    ax
-	push    bx
 	push    cx
-	push 	di
-	call    LBAToCHS                              ; Convert starting sector to CHS
-	mov     ah, 2                            	  ; BIOS read sector function
-	mov     al, 1                            	  ; Read one sector
-	mov     dl, byte [bsDriveNumber]              
-	int     13h                                   ; invoke BIOS to read the sector
-	jnc     ReadSuccess                           ; Read was successful
-	xor     ax, ax                                ; If not successful, invoke BIOS call to reset disk
-	int     13h                                  
-	pop		di
-	dec     di                                    ; Decrement error counter
+	cmp		byte [diskExtensions], 0
+	je		AttemptRead_CHS
+	mov		word [dapSectorCount], di			; Fill in the disk address packet
+	mov		word [dapOffset], bx
+	mov		word [dapSegment], es
+	mov		word [dapSector], ax
+	mov		si, diskAddressPacket
+	mov		ah, 42h								; BIOS extended read function
+	mov		dl, byte [bsDriveNumber]
+	int		13h
+	jmp		AttemptRead_Check
+
+AttemptRead_CHS:
+	call    LBAToCHS                            ; Convert starting sector to CHS
+	mov		ax, word [bpbSectorsPerTrack]		; Do not read past the end of the track
+	inc		ax
+	sub		al, cl
+	cmp		di, ax
+	jbe		AttemptRead_Track
+	mov		di, ax
+
+AttemptRead_Track:
+	mov		ax, di
+	mov     ah, 2                            	; BIOS read sector function
+	mov     dl, byte [bsDriveNumber]
+	int     13h                                 ; invoke BIOS to read the sectors
+
+AttemptRead_Check:
 	pop     cx
-	pop     bx
 	pop     ax
-	jnz     AttemptRead                           ; Attempt to read again
-	int     18h									  ; Read still failed.  Reboot
+	jnc     ReadSuccess                         ; Read was successful
+	push	ax
+	xor     ax, ax                              ; If not successful, invoke BIOS call to reset disk
+	mov     dl, byte [bsDriveNumber]
+	int     13h
+	pop		ax
+	dec     bp                                  ; Decrement error counter
+	jnz     AttemptRead                         ; Attempt to read again
+	int     18h									; Read still failed.  Reboot
 
 ReadSuccess:
+	add		ax, di								; Update LBA
+	sub		cx, di								; and the number of sectors left to read
+	mov		dx, di								; Move the buffer past the sectors read (512 bytes = 32 paragraphs each)
+	shl		dx, 5
+	mov		si, es
+	add		si, dx
+	mov		es, si
+	jmp		ReadSectors_Next
+
+ReadSectors_Done:
+	pop		bp
 	pop		di
-	pop     cx
-	pop     bx
-	pop     ax
-	add     bx, word [bpbBytesPerSector]        ; Update buffer pointer to point to next location to read to
-	inc     ax                                  ; Increment LBA
-	loop    ReadSectors                         ; read next sector
+	pop		si
+	pop		dx
 	ret
-
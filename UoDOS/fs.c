@@ -2,6 +2,7 @@
 #include "defs.h"
 #include "param.h"
 #include "stat.h"
+#include "dirent.h"
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
@@ -10,6 +11,7 @@
 #include "buf.h"
 #include "file.h"
 #include "bpb.h"
+#include "vfs.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
@@ -20,43 +22,29 @@
 #define tolower(c)	(isupper(c) ? c + 'a' - 'A' : c)
 #define toupper(c)	(islower(c) ? c + 'A' - 'a' : c)
 
-BootSector bootSector;
-MountInfo  mountInfo;
+// FAT file system (FAT12, FAT16 and FAT32).
+//
+// This is a back end for the vfs (see vfs.c).  The vnode for a file holds a
+// copy of its directory entry.  The vnode id is the file's first cluster,
+// except for the root directory, which has id 0, and for empty files, which
+// have no cluster and so are not shared.  The root directory is described by
+// a made up directory entry with a first cluster of 0, the same as the ".."
+// entries that refer to it; on FAT12 and FAT16 it is a fixed area of the disk
+// and on FAT32 it is an ordinary cluster chain starting at RootCluster.
+//
+// The FAT itself is not held in memory.  Entries are read through the buffer
+// cache as chains are followed, so only the FAT sectors in use are loaded.
 
-// File Allocation Table 
-unsigned char fat[512 * MAXFATSIZE];
+#define FAT_ROOT_ID		0
 
-void fsFat12Initialise(void)
+// Per mount information, pointed to by Mount->Private.  The lock protects
+// the slots.  The cluster hints in FatNodes have their own locks.
+
+struct
 {
-	DiskBuffer * bpb = diskBufferRead(0, 0);
-	memmove(&bootSector, bpb->Data, sizeof(BootSector));
-	diskBufferRelease(bpb);
-	// Store mount info
-	if (bootSector.Bpb.BytesPerSector != 512)
-	{
-		panic("Sector size != 512");
-	}
-	mountInfo.NumSectors = bootSector.Bpb.NumSectors;
-	mountInfo.FatOffset = bootSector.Bpb.ReservedSectors;
-	mountInfo.FatSize = bootSector.Bpb.SectorsPerFat;
-	mountInfo.NumRootEntries = bootSector.Bpb.NumDirEntries;
-	mountInfo.RootOffset = (bootSector.Bpb.NumberOfFats * bootSector.Bpb.SectorsPerFat) + bootSector.Bpb.ReservedSectors;
-	mountInfo.RootSize = (bootSector.Bpb.NumDirEntries * 32) / bootSector.Bpb.BytesPerSector;
-	mountInfo.ClusterSize = bootSector.Bpb.SectorsPerCluster * bootSector.Bpb.BytesPerSector;
-	// Read the FAT into memory
-	if (mountInfo.FatSize > MAXFATSIZE)
-	{
-		panic("FAT too large");
-	}
-	uint32_t fatOffset = 0;
-	for (int fatSector = 0; fatSector < mountInfo.FatSize; fatSector++)
-	{
-		DiskBuffer * fatContents = diskBufferRead(0, fatSector + mountInfo.FatOffset);
-		memmove(&fat + fatOffset, fatContents->Data, 512);
-		diskBufferRelease(fatContents);
-		fatOffset += 512;
-	}
-}
+	Spinlock		Lock;
+	MountInfo		Info[NMOUNT];
+} fatMounts;
 
 // Helper function. Converts filename to DOS 8.3 file format
 
@@ -113,45 +101,112 @@ void toDosFileName(const char* filename, char* convertedFileName, unsigned int f
 	}
 }
 
-uint32_t fsFat12ReadCluster(uint32_t deviceNumber, uint32_t clusterNumber, unsigned char * buffer, uint32_t offset, uint32_t size)
+// Return the first cluster of a file or directory.  The high word is only
+// used on FAT32; on FAT12 and FAT16 that field has other uses.
+
+static uint32_t fsFatFirstCluster(MountInfo * info, DirectoryEntry * directoryEntry)
 {
-	DiskBuffer * sectorContents;
-	uint32_t sectorContentsSize;
-	uint32_t readSize;
+	uint32_t cluster = directoryEntry->FirstCluster;
 
-	if (size > mountInfo.ClusterSize)
+	if (info->FatType == 32)
 	{
-		size = mountInfo.ClusterSize;
+		cluster |= (uint32_t)directoryEntry->FirstClusterHiBytes << 16;
 	}
-	if (offset >= mountInfo.ClusterSize)
+	return cluster;
+}
+
+// Read size bytes of the FAT starting at byte offset.  Only a FAT12 entry can
+// straddle two sectors.
+
+static uint32_t fsFatReadTable(MountInfo * info, uint32_t offset, int size)
+{
+	DiskBuffer * fatContents;
+	uint32_t value = 0;
+	uint32_t sectorOffset = offset % BSIZE;
+
+	if (sectorOffset + size <= BSIZE)
 	{
-		offset = 0;
+		fatContents = diskBufferRead(info->Device, info->FatOffset + offset / BSIZE);
+		memmove(&value, &fatContents->Data[sectorOffset], size);
+		diskBufferRelease(fatContents);
+		return value;
 	}
-	if (offset + size > mountInfo.ClusterSize)
+	for (int i = 0; i < size; i++)
 	{
-		size = mountInfo.ClusterSize - offset;
+		fatContents = diskBufferRead(info->Device, info->FatOffset + (offset + i) / BSIZE);
+		value |= (uint32_t)fatContents->Data[(offset + i) % BSIZE] << (i * 8);
+		diskBufferRelease(fatContents);
 	}
-	uint32_t sector = mountInfo.RootOffset + mountInfo.RootSize + ((clusterNumber - 2) * bootSector.Bpb.SectorsPerCluster);
-	uint32_t sectorOffset = 0;
-	if (offset > 0)
+	return value;
+}
+
+// Return the cluster after this one in a chain, or 0 at the end of the chain
+
+uint32_t fsFatGetNextCluster(MountInfo * info, uint32_t cluster)
+{
+	uint32_t nextCluster;
+	uint32_t endOfChain;
+
+	switch (info->FatType)
 	{
-		sectorOffset = offset / bootSector.Bpb.BytesPerSector;
-		sector += sectorOffset;
-		offset = offset % bootSector.Bpb.BytesPerSector;
-		if (size > mountInfo.ClusterSize - (sectorOffset * bootSector.Bpb.BytesPerSector + offset))
-		{
-			size = mountInfo.ClusterSize - (sectorOffset * bootSector.Bpb.BytesPerSector + offset);
-		}
+		case 12:
+			nextCluster = fsFatReadTable(info, cluster + (cluster / 2), 2);	//multiply by 1.5
+			// Test if entry is odd or even
+			if (cluster & 0x0001)
+			{
+				// Get high 12 bits
+				nextCluster >>= 4;
+			}
+			else
+			{
+				nextCluster &= 0x0FFF;
+			}
+			endOfChain = 0xFF7;
+			break;
+
+		case 16:
+			nextCluster = fsFatReadTable(info, cluster * 2, 2);
+			endOfChain = 0xFFF7;
+			break;
+
+		default:
+			nextCluster = fsFatReadTable(info, cluster * 4, 4) & 0x0FFFFFFF;
+			endOfChain = 0x0FFFFFF7;
+			break;
 	}
+	// Test for end of file or a bad cluster
+	if (nextCluster >= endOfChain)
+	{
+		return 0;
+	}
+	// Test for file corruption
+	if (nextCluster < 2 || nextCluster >= info->ClusterCount + 2)
+	{
+		return 0;
+	}
+	return nextCluster;
+}
+
+// Read up to size bytes from a cluster, starting at offset within it
+
+uint32_t fsFatReadCluster(MountInfo * info, uint32_t clusterNumber, unsigned char * buffer, uint32_t offset, uint32_t size)
+{
+	DiskBuffer * sectorContents;
+	uint32_t sectorContentsSize;
+	uint32_t readSize;
+
+	if (offset >= info->ClusterSize)
+	{
+		return 0;
+	}
+	size = min(size, info->ClusterSize - offset);
+	uint32_t sector = info->DataOffset + (clusterNumber - 2) * info->SectorsPerCluster + offset / BSIZE;
+	offset = offset % BSIZE;
 	readSize = size;
 	while (size > 0)
 	{
-		sectorContents = diskBufferRead(0, sector);
-		sectorContentsSize = bootSector.Bpb.BytesPerSector;
-		if (size < bootSector.Bpb.BytesPerSector)
-		{
-			sectorContentsSize = size;
-		}
+		sectorContents = diskBufferRead(info->Device, sector);
+		sectorContentsSize = min(size, BSIZE - offset);
 		memmove(buffer, (const void *)(&sectorContents->Data[0] + offset), sectorContentsSize);
 		diskBufferRelease(sectorContents);
 		offset = 0;
@@ -162,299 +217,473 @@ uint32_t fsFat12ReadCluster(uint32_t deviceNumber, uint32_t clusterNumber, unsig
 	return readSize;
 }
 
-File * fsFat12CreateFileStructure(DirectoryEntry * directoryEntry, const char * filename)
+// Results from fsFatScanEntries other than the index of a matching entry
+
+#define SCAN_NOT_FOUND			-1		// Not in these entries, keep looking
+#define SCAN_END_OF_DIRECTORY	-2		// Hit the end-of-directory marker
+
+// Search a block of directory entries for a packed (space padded, not NUL terminated)
+// 8.3 name.  Names are compared in place as a dword, dword, word and byte, and most
+// entries are rejected on their first byte alone.  An entry whose first byte is 0
+// marks the end of the directory, so there is no point looking any further.
+
+static int fsFatScanEntries(DirectoryEntry * entries, int count, const char * dosFileName)
 {
-	File * file = allocateFileStructure();
-	if (file == 0)
+	uint8_t firstCharacter = (uint8_t)dosFileName[0];
+	uint32_t name0 = *(const uint32_t *)dosFileName;
+	uint32_t name1 = *(const uint32_t *)(dosFileName + 4);
+	uint16_t name2 = *(const uint16_t *)(dosFileName + 8);
+	uint8_t name3 = (uint8_t)dosFileName[10];
+
+	for (int i = 0; i < count; i++)
 	{
-		return 0;
+		const uint8_t * name = entries[i].Filename;
+		if (name[0] != firstCharacter)
+		{
+			if (name[0] == 0)
+			{
+				return SCAN_END_OF_DIRECTORY;
+			}
+			continue;
+		}
+		if (*(const uint32_t *)name == name0 &&
+			*(const uint32_t *)(name + 4) == name1 &&
+			*(const uint16_t *)(name + 8) == name2 &&
+			name[10] == name3)
+		{
+			return i;
+		}
 	}
-	strcpy(file->Name, filename);
-	memmove(&file->DirectoryEntry, directoryEntry, sizeof(DirectoryEntry));
-	file->Size = directoryEntry->FileSize;
-	file->Position = 0;
-	file->Eof = 0;
-	file->Type = FD_FILE;
-	return file;
+	return SCAN_NOT_FOUND;
 }
 
+// Read from the FAT12 or FAT16 root directory, which is a fixed-size area of
+// the disk rather than a cluster chain.
 
-// Locates file or directory in root directory
-
-bool fsFat12FindInRootDirectory(const char* nameToFind, DirectoryEntry * foundDirectoryEntry)
+static uint32_t fsFatReadRootDirectory(MountInfo * info, uint32_t position, unsigned char* buffer, unsigned int length)
 {
-	DiskBuffer * buf;
-	DirectoryEntry * directoryEntry;
-	// Get 8.3 directory name
-	char dosFileName[12];
-	toDosFileName(nameToFind, dosFileName, 11);
-	dosFileName[11] = 0;
+	DiskBuffer * sectorContents;
+	uint32_t rootDirectorySize = info->NumRootEntries * sizeof(DirectoryEntry);
+	uint32_t totalRead = 0;
+	uint32_t offset;
+	uint32_t readLength;
 
-	int rootDirectorySectorCount = mountInfo.NumRootEntries / 16;
-	for (int sector = 0; sector < rootDirectorySectorCount; sector++)
+	while (length > 0 && position < rootDirectorySize)
 	{
-		// Read in sector of root directory
-		buf = diskBufferRead(0, mountInfo.RootOffset + sector);
-		// get directory entry info
-		directoryEntry = (DirectoryEntry *)buf->Data;
+		offset = position % BSIZE;
+		readLength = min(min(length, BSIZE - offset), rootDirectorySize - position);
+		sectorContents = diskBufferRead(info->Device, info->RootOffset + position / BSIZE);
+		memmove(buffer, &sectorContents->Data[offset], readLength);
+		diskBufferRelease(sectorContents);
+		buffer += readLength;
+		length -= readLength;
+		totalRead += readLength;
+		position += readLength;
+	}
+	return totalRead;
+}
+
+// Read from the file or directory described by a directory entry, starting at
+// position.  Files stop at their size; directories (whose size is always 0)
+// stop at the end of their cluster chain.
+//
+// Seeking means following the chain from the start, so if node is not 0 the
+// last cluster visited is remembered in it and later reads at or beyond that
+// point start from there instead.  The hint is a pair, so it is read and written
+// under the vnode's own HintLock.
+
+static uint32_t fsFatReadEntry(MountInfo * info, DirectoryEntry * directoryEntry, FatNode * node, uint32_t position, unsigned char* buffer, unsigned int length)
+{
+	uint32_t readLength = 0;
+	uint32_t totalRead = 0;
+	uint32_t currentCluster = fsFatFirstCluster(info, directoryEntry);
+	uint32_t clusterIndex = 0;
 
-		// 16 entries per sector
-		for (int i = 0; i<16; i++)
+	if (directoryEntry->Attrib & ATTRIB_DIRECTORY)
+	{
+		if (currentCluster == 0)
 		{
-			if (*(directoryEntry->Filename) != 0)
+			// The root directory
+			if (info->FatType != 32)
 			{
-				// get filename from directory entry
-				char name[12];
-				memmove(name, directoryEntry->Filename, 11);
-				name[11] = 0;
-
-				// Is there a match?
-				if (strcmp(dosFileName, name) == 0)
-				{
-					// Found it
-					memmove((char *)foundDirectoryEntry, (char *)directoryEntry, sizeof(DirectoryEntry));
-					diskBufferRelease(buf);
-					return 1;
-				}
+				return fsFatReadRootDirectory(info, position, buffer, length);
 			}
-			//! go to next directory
-			directoryEntry++;
+			currentCluster = info->RootCluster;
+		}
+	}
+	else
+	{
+		if (position >= directoryEntry->FileSize)
+		{
+			return 0;
+		}
+		length = min(length, directoryEntry->FileSize - position);
+	}
+	// Calculate starting cluster
+	uint32_t clusterHops = position / info->ClusterSize;
+	uint32_t clusterOffset = position % info->ClusterSize;
+	if (node)
+	{
+		spinlockAcquire(&node->HintLock);
+		if (node->HintCluster != 0 && node->HintIndex <= clusterHops)
+		{
+			currentCluster = node->HintCluster;
+			clusterIndex = node->HintIndex;
+		}
+		spinlockRelease(&node->HintLock);
+	}
+	while (clusterIndex < clusterHops && currentCluster != 0)
+	{
+		// Follow the cluster chain to get to the cluster we want to start with
+		currentCluster = fsFatGetNextCluster(info, currentCluster);
+		clusterIndex++;
+	}
+	uint32_t lastCluster = 0;
+	uint32_t lastIndex = 0;
+	while (length > 0 && currentCluster != 0)
+	{
+		lastCluster = currentCluster;
+		lastIndex = clusterIndex;
+		readLength = fsFatReadCluster(info, currentCluster, buffer, clusterOffset, length);
+		buffer += readLength;
+		length -= readLength;
+		totalRead += readLength;
+		if (clusterOffset + readLength == info->ClusterSize)
+		{
+			currentCluster = fsFatGetNextCluster(info, currentCluster);
+			clusterIndex++;
+		}
+		clusterOffset = 0;
+	}
+	// Remember the last cluster visited, once for the whole read
+	if (node && lastCluster != 0)
+	{
+		spinlockAcquire(&node->HintLock);
+		node->HintCluster = lastCluster;
+		node->HintIndex = lastIndex;
+		spinlockRelease(&node->HintLock);
+	}
+	return totalRead;
+}
+
+// Add a block of directory entries to the index for a directory.
+// Returns 1 if the end-of-directory marker was reached.
+
+static int fsFatIndexEntries(MountInfo * info, uint32_t directoryCluster, DirectoryEntry * entries, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		if (entries[i].Filename[0] == 0)
+		{
+			return 1;
+		}
+		if (entries[i].Filename[0] != 0xE5)
+		{
+			directoryIndexAdd(info->Device, directoryCluster, &entries[i]);
 		}
-		diskBufferRelease(buf);
 	}
 	return 0;
 }
 
-// Locate a file or folder in subdirectory. 
-//
+// Read a whole directory into its index.
+
+static void fsFatIndexDirectory(MountInfo * info, uint32_t directoryCluster, DirectoryEntry * directory)
+{
+	DirectoryEntry entries[16];
+	uint32_t readLength;
+	uint32_t position = 0;
+
+	while ((readLength = fsFatReadEntry(info, directory, 0, position, (unsigned char *)entries, sizeof(entries))) > 0)
+	{
+		position += readLength;
+		if (fsFatIndexEntries(info, directoryCluster, entries, readLength / sizeof(DirectoryEntry)))
+		{
+			break;
+		}
+	}
+}
+
+// Look up a name using the directory's hash index, building the index first
+// if this directory does not have one yet.  Returns DIRINDEX_NOT_INDEXED if
+// the directory could not be indexed and must be scanned instead.
+
+static int fsFatIndexedLookup(MountInfo * info, DirectoryEntry * directory, const char * dosFileName, DirectoryEntry * foundDirectoryEntry)
+{
+	uint32_t directoryCluster = fsFatFirstCluster(info, directory);
+	int result = directoryIndexLookup(info->Device, directoryCluster, dosFileName, foundDirectoryEntry);
+	if (result == DIRINDEX_NOT_INDEXED && directoryIndexBegin(info->Device, directoryCluster))
+	{
+		fsFatIndexDirectory(info, directoryCluster, directory);
+		directoryIndexEnd(info->Device, directoryCluster);
+		result = directoryIndexLookup(info->Device, directoryCluster, dosFileName, foundDirectoryEntry);
+	}
+	return result;
+}
+
+// Locate a file or folder in a directory (which may be the root directory).
+// On entry, foundDirectoryEntry is the directory entry of the directory to
+// search.  On success it is replaced by the entry that was found.
 
-bool fsFat12FindInSubDirectory(const char* nameToFind, DirectoryEntry * foundDirectoryEntry)
+static bool fsFatFindInDirectory(MountInfo * info, const char* nameToFind, DirectoryEntry * foundDirectoryEntry)
 {
-	unsigned char buf[512];
+	DirectoryEntry entries[16];
+	uint32_t readLength;
+	uint32_t position = 0;
+	int found;
 
-	// Take a copy of the directory entry for the sub-directory we are going to search
+	// Take a copy of the directory entry for the directory we are going to search.
+	// A first cluster of 0 (for example in "..") refers to the root directory.
 	DirectoryEntry currentDirectory;
 	memmove((char *)&currentDirectory, (char *)foundDirectoryEntry, sizeof(DirectoryEntry));
-	
-	// Create a file structure for it - we don' bother with a name
-	File * subDirectory = fsFat12CreateFileStructure(&currentDirectory, "");
 
-	// Get 8.3 name for sub-directory we are searching for
+	// Get 8.3 name for file we are searching for
 	char dosFileName[12];
 	toDosFileName(nameToFind, dosFileName, 11);
 	dosFileName[11] = 0;
 
-	//! read directory
-	while (!subDirectory->Eof)
+	found = fsFatIndexedLookup(info, &currentDirectory, dosFileName, foundDirectoryEntry);
+	if (found != DIRINDEX_NOT_INDEXED)
 	{
-		// Read directory
-		fsFat12Read(subDirectory, buf, 512);
-
-		DirectoryEntry * subDirectoryEntry = (DirectoryEntry *)buf;
+		return found == DIRINDEX_FOUND;
+	}
 
-		// 16 entries in buffer
-		for (unsigned int i = 0; i < 16; i++)
+	// No index, so scan the directory
+	while ((readLength = fsFatReadEntry(info, &currentDirectory, 0, position, (unsigned char *)entries, sizeof(entries))) > 0)
+	{
+		position += readLength;
+		found = fsFatScanEntries(entries, readLength / sizeof(DirectoryEntry), dosFileName);
+		if (found >= 0)
 		{
-			// Get current filename
-			char name[12];
-			memmove(name, subDirectoryEntry->Filename, 11);
-			name[11] = 0;
-			// Is there a match?
-			if (strcmp(name, dosFileName) == 0)
-			{
-				memmove((char *)foundDirectoryEntry, (char *)subDirectoryEntry, sizeof(DirectoryEntry));
-				fileClose(subDirectory);
-				return 1;
-			}
-			// go to next entry
-			subDirectoryEntry++;
+			memmove((char *)foundDirectoryEntry, (char *)&entries[found], sizeof(DirectoryEntry));
+			return 1;
+		}
+		if (found == SCAN_END_OF_DIRECTORY)
+		{
+			break;
 		}
 	}
-
-	// unable to find file
-	fileClose(subDirectory);
 	return 0;
 }
 
-uint32_t fsFat12GetNextCluster(uint32_t cluster)
+// Vnode operations
+
+static int fsFatMount(Mount * mount)
 {
-	unsigned int fatOffset = cluster + (cluster / 2); //multiply by 1.5
-	uint16_t nextCluster = *(uint16_t*)&fat[fatOffset];
+	BootSector bootSector;
+	MountInfo * info = 0;
 
-	// Test if entry is odd or even
-	if (cluster & 0x0001)
+	DiskBuffer * bpb = diskBufferRead(mount->Device, 0);
+	memmove(&bootSector, bpb->Data, sizeof(BootSector));
+	diskBufferRelease(bpb);
+	if (bootSector.Bpb.BytesPerSector != BSIZE)
 	{
-		// Get high 12 bits
-		nextCluster >>= 4;
+		cprintf("fat: sector size is not %d\n", BSIZE);
+		return -1;
 	}
-	else
+	if (bootSector.Bpb.SectorsPerCluster == 0 || bootSector.Bpb.NumberOfFats == 0)
 	{
-		nextCluster &= 0x0FFF;
+		cprintf("fat: not a FAT file system\n");
+		return -1;
 	}
-	// Test for end of file
-	if (nextCluster >= 0xff8)
+	spinlockAcquire(&fatMounts.Lock);
+	for (MountInfo * candidate = fatMounts.Info; candidate < &fatMounts.Info[NMOUNT]; candidate++)
 	{
-		return 0;
+		if (candidate->Mount == 0)
+		{
+			info = candidate;
+			memset(info, 0, sizeof(MountInfo));
+			info->Mount = mount;
+			break;
+		}
 	}
-	// Test for file corruption
-	if (nextCluster == 0)
+	spinlockRelease(&fatMounts.Lock);
+	if (info == 0)
 	{
-		return 0;
+		return -1;
 	}
-	return nextCluster;
+
+	// Store mount info.  The FAT type depends only on the number of clusters.
+	info->Device = mount->Device;
+	info->NumSectors = bootSector.Bpb.NumSectors ? bootSector.Bpb.NumSectors : bootSector.Bpb.LongSectors;
+	info->FatOffset = bootSector.Bpb.ReservedSectors;
+	info->FatSize = bootSector.Bpb.SectorsPerFat ? bootSector.Bpb.SectorsPerFat : bootSector.BpbExt.SectorsPerFat32;
+	info->NumRootEntries = bootSector.Bpb.NumDirEntries;
+	info->RootOffset = (bootSector.Bpb.NumberOfFats * info->FatSize) + bootSector.Bpb.ReservedSectors;
+	info->RootSize = (bootSector.Bpb.NumDirEntries * sizeof(DirectoryEntry) + BSIZE - 1) / BSIZE;
+	info->DataOffset = info->RootOffset + info->RootSize;
+	info->SectorsPerCluster = bootSector.Bpb.SectorsPerCluster;
+	info->ClusterSize = bootSector.Bpb.SectorsPerCluster * BSIZE;
+	info->ClusterCount = (info->NumSectors - info->DataOffset) / info->SectorsPerCluster;
+	if (info->ClusterCount < 4085)
+	{
+		info->FatType = 12;
+	}
+	else if (info->ClusterCount < 65525)
+	{
+		info->FatType = 16;
+	}
+	else
+	{
+		info->FatType = 32;
+		info->RootCluster = bootSector.BpbExt.RootCluster;
+	}
+	mount->Private = info;
+
+	// The root directory has no directory entry of its own, so make one up
+	Vnode root;
+	memset(&root, 0, sizeof(Vnode));
+	root.Type = T_DIR;
+	root.Data.Fat.Entry.Attrib = ATTRIB_DIRECTORY;
+	spinlockInitialise(&root.Data.Fat.HintLock, "fathint");
+	mount->Root = vnodeGet(mount, FAT_ROOT_ID, &root);
+	if (mount->Root == 0)
+	{
+		// Give the slot back under the lock that guards the slots
+		spinlockAcquire(&fatMounts.Lock);
+		info->Mount = 0;
+		spinlockRelease(&fatMounts.Lock);
+		return -1;
+	}
+	return 0;
 }
 
-// Read from a file
+static void fsFatFillVnode(Vnode * vnode, DirectoryEntry * directoryEntry)
+{
+	memset(vnode, 0, sizeof(Vnode));
+	memmove(&vnode->Data.Fat.Entry, directoryEntry, sizeof(DirectoryEntry));
+	vnode->Type = (directoryEntry->Attrib & ATTRIB_DIRECTORY) ? T_DIR : T_FILE;
+	vnode->Size = directoryEntry->FileSize;
+	spinlockInitialise(&vnode->Data.Fat.HintLock, "fathint");
+}
 
-uint32_t fsFat12Read(File * file, unsigned char* buffer, unsigned int length)
+static int fsFatLookup(Vnode * directory, const char * name, Vnode ** result)
 {
-	uint32_t readLength = 0;
-	uint32_t totalRead = 0;
+	MountInfo * info = directory->Mount->Private;
+	DirectoryEntry directoryEntry;
+	Vnode vnode;
+	uint32_t id;
 
-	if (file && (file->Type == FD_FILE || file->Type == FD_DIR) && file->Eof == 0)
+	memmove(&directoryEntry, &directory->Data.Fat.Entry, sizeof(DirectoryEntry));
+	if (fsFatFindInDirectory(info, name, &directoryEntry) == 0)
 	{
-		// Calculate starting cluster
-		uint32_t clusterHops = file->Position / mountInfo.ClusterSize;
-		uint32_t clusterOffset = file->Position % mountInfo.ClusterSize;
-		uint32_t currentCluster = file->DirectoryEntry.FirstCluster;
-		while (clusterHops > 0)
-		{
-			// Follow the cluster chain to get to the cluster we want to start with
-			currentCluster = fsFat12GetNextCluster(currentCluster);
-			clusterHops--;
-		}
-		while (length > 0)
-		{
-			readLength = fsFat12ReadCluster(0, currentCluster, buffer, clusterOffset, length);
-			buffer += readLength;
-			length -= readLength;
-			totalRead += readLength;
-			file->Position += readLength;
-			if (file->Position >= file->Size && file->Type == FD_FILE)
-			{
-				file->Eof = 1;
-				return totalRead;
-			}
-			if (clusterOffset + readLength == mountInfo.ClusterSize)
-			{
-				currentCluster = fsFat12GetNextCluster(currentCluster);
-			}
-			clusterOffset = 0;
-			if (currentCluster == 0)
-			{
-				file->Eof = 1;
-				return totalRead;
-			}
-		}
+		return -1;
 	}
-	return totalRead;
+	fsFatFillVnode(&vnode, &directoryEntry);
+	id = fsFatFirstCluster(info, &directoryEntry);
+	if (id == 0 && !(directoryEntry.Attrib & ATTRIB_DIRECTORY))
+	{
+		// An empty file
+		id = VNODE_NOID;
+	}
+	*result = vnodeGet(directory->Mount, id, &vnode);
+	return *result ? 0 : -1;
 }
 
-//	Closes file
+static int fsFatRead(Vnode * vnode, uint32_t position, char * buffer, uint32_t length)
+{
+	return fsFatReadEntry(vnode->Mount->Private, &vnode->Data.Fat.Entry, &vnode->Data.Fat, position, (unsigned char *)buffer, length);
+}
+
+// Fill in a Stat structure from the file's directory entry
 
-void fsFat12Close(File * file)
+static int fsFatStat(Vnode * vnode, Stat * st)
 {
-	if (file)
-	{
-		file->Type = FD_NONE;
-	}
+	DirectoryEntry * directoryEntry = &vnode->Data.Fat.Entry;
+
+	st->type = vnode->Type;
+	st->dev = vnode->Mount->Device;
+	st->ino = fsFatFirstCluster(vnode->Mount->Private, directoryEntry);
+	st->nlink = 1;
+	st->size = directoryEntry->FileSize;
+	st->ctime = ((uint32_t)directoryEntry->DateCreated << 16) | directoryEntry->TimeCreated;
+	st->mtime = ((uint32_t)directoryEntry->LastModDate << 16) | directoryEntry->LastModTime;
+	st->atime = (uint32_t)directoryEntry->DateLastAccessed << 16;
+	return 0;
 }
 
-// Parse path to get next directory or filename on path. 
-// Returns 0 if we are returning the filename in pathPart or 
-// the length of the directory name if it is a directory name
+// Convert a directory entry into a Dirent, turning the padded 8.3 name
+// into "NAME.EXT" form.
 
-int fsGetPathPart(char * path, char * pathPart)
+static void fsFatDecodeDirectoryEntry(MountInfo * info, DirectoryEntry * directoryEntry, Dirent * dirent)
 {
-	char * p = path;
-	while (*p != 0 && *p != '\\' && *p != '/')
+	int length = 0;
+	int i;
+
+	for (i = 0; i < 8 && directoryEntry->Filename[i] != ' '; i++)
 	{
-		p++;
+		dirent->name[length++] = directoryEntry->Filename[i];
 	}
-	int partLength = (int)(p - path);
-	strcpy(pathPart, path);
-	*(pathPart + partLength) = 0;	
-	if (*p == 0)
+	if (directoryEntry->Ext[0] != ' ')
 	{
-		return 0;
-	}
-	else
-	{
-		return partLength;
+		dirent->name[length++] = '.';
+		for (i = 0; i < 3 && directoryEntry->Ext[i] != ' '; i++)
+		{
+			dirent->name[length++] = directoryEntry->Ext[i];
+		}
 	}
+	dirent->name[length] = 0;
+	dirent->attrib = directoryEntry->Attrib;
+	dirent->type = (directoryEntry->Attrib & ATTRIB_DIRECTORY) ? T_DIR : T_FILE;
+	dirent->ino = fsFatFirstCluster(info, directoryEntry);		// The same as fsFatStat gives
+	dirent->size = directoryEntry->FileSize;
+	dirent->mtime = ((uint32_t)directoryEntry->LastModDate << 16) | directoryEntry->LastModTime;
 }
 
-//  Open a file
-//
-//  cwd = 		The current working directory
-//  filename  = The path of the file to open.  If it does not begin with a '\' or '/'. we prepend cwd to the filename
-//  directory = 1 if we are opening a sub-directory, 0 otherwise
+// Read up to count entries from a directory, starting at *position.  Deleted
+// entries, long file name entries and the volume label are skipped.  Returns
+// the number of entries stored in dirents (0 at the end of the directory).
 
-File * fsFat12Open(const char * cwd, const char* filename, int directory)
+static int fsFatReadDirectory(Vnode * vnode, uint32_t * position, Dirent * dirents, int count)
 {
-	DirectoryEntry currentDirectoryEntry;
-	char * p = 0;
-	bool rootDirectory = true;
-	char path[255];
-	char pathPart[20];
-	int partLength;
-	
-	if (*filename == '\\' || *filename == '/')
-	{
-		safestrcpy(path, filename, MAXCWDSIZE);
-	}
-	else
-	{
-		safestrcpy(path, cwd, MAXCWDSIZE);
-		int cwdLen = strlen(cwd);
-		safestrcpy(path + cwdLen, filename, MAXCWDSIZE - cwdLen);
-	}
-	// Move past first '/' or '\'
-	p = path + 1;
-	while (p)
+	MountInfo * info = vnode->Mount->Private;
+	DirectoryEntry entries[16];
+	uint32_t readLength;
+	int filled = 0;
+
+	while (filled < count)
 	{
-		partLength = fsGetPathPart(p, pathPart);
-		if (rootDirectory)
+		// Read no more entries than we could possibly return, so that the
+		// position is left at the first entry we have not returned
+		int wanted = min(count - filled, (int)NELEM(entries));
+		readLength = fsFatReadEntry(info, &vnode->Data.Fat.Entry, &vnode->Data.Fat, *position, (unsigned char *)entries, wanted * sizeof(DirectoryEntry));
+		int n = readLength / sizeof(DirectoryEntry);
+		if (n == 0)
 		{
-			// Search root directory 
-			if (fsFat12FindInRootDirectory(pathPart, &currentDirectoryEntry) == 0)
-			{
-				// This part of the path was not found in the directory
-				return 0;
-			}
-			rootDirectory = false;
+			break;
 		}
-		else
+		for (int i = 0; i < n; i++)
 		{
-			// Search subdirectory
-			if (fsFat12FindInSubDirectory(pathPart, &currentDirectoryEntry) == 0)
+			uint8_t first = entries[i].Filename[0];
+			if (first == 0)
 			{
-				// This part of the path was not found in the directory
-				return 0;
+				// End of directory.  Leave the position on the marker.
+				return filled;
 			}
-		}	
-		// If we got here, we do have a match for this part of the path
-		if (partLength == 0)
-		{
-			// If we are trying to open a directory, but we have not found a directory, return error
-			if (directory == 1 && currentDirectoryEntry.Attrib != 0x10)
+			*position += sizeof(DirectoryEntry);
+			if (first == 0xE5 || (entries[i].Attrib & ATTRIB_LONGNAME) == ATTRIB_LONGNAME || (entries[i].Attrib & ATTRIB_VOLUMEID))
 			{
-				return 0;
+				continue;
 			}
-			// This is the filename component, so just return a file structure
-			File * fileStructure = fsFat12CreateFileStructure(&currentDirectoryEntry, filename);			
-			if (directory == 1)
-			{
-				fileStructure->Type = FD_DIR;			
-			} 
-			return fileStructure;
+			fsFatDecodeDirectoryEntry(info, &entries[i], &dirents[filled++]);
 		}
-		// Check to see if we found a directory.  If not, then we cannot continue
-		if (currentDirectoryEntry.Attrib != 0x10)
-		{
-			return 0;
-		}
-		p = p + partLength + 1;
 	}
-	return 0;
+	return filled;
+}
+
+FileSystemOperations fsFatOperations =
+{
+	.Name = "fat",
+	.Mount = fsFatMount,
+	.Lookup = fsFatLookup,
+	.Read = fsFatRead,
+	.Write = 0,
+	.ReadDirectory = fsFatReadDirectory,
+	.Stat = fsFatStat,
+	.Release = 0,
+};
+
+void fsFatInitialise(void)
+{
+	spinlockInitialise(&fatMounts.Lock, "fatMounts");
+	directoryIndexInitialise();
 }
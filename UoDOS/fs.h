@@ -1,4 +1,14 @@
 
+// Directory entry attribute bits
+
+#define ATTRIB_READONLY		0x01
+#define ATTRIB_HIDDEN		0x02
+#define ATTRIB_SYSTEM		0x04
+#define ATTRIB_VOLUMEID		0x08
+#define ATTRIB_DIRECTORY	0x10
+#define ATTRIB_ARCHIVE		0x20
+#define ATTRIB_LONGNAME		0x0F
+
 struct _DirectoryEntry
 {
 	uint8_t   Filename[8];
@@ -20,12 +30,35 @@ struct _DirectoryEntry
 
 struct _MountInfo
 {
+	Mount *  Mount;				// 0 if this entry is free
+	uint32_t Device;
+	uint32_t FatType;			// 12, 16 or 32
 	uint32_t NumSectors;
 	uint32_t FatOffset;
-	uint32_t NumRootEntries;
+	uint32_t NumRootEntries;	// FAT12 and FAT16 only
 	uint32_t RootOffset;
 	uint32_t RootSize;
+	uint32_t RootCluster;		// FAT32 only
 	uint32_t FatSize;
+	uint32_t DataOffset;		// First sector of cluster 2
+	uint32_t SectorsPerCluster;
 	uint32_t ClusterSize;
+	uint32_t ClusterCount;
+};
+
+// FAT specific part of a vnode
+
+struct _FatNode
+{
+	DirectoryEntry	Entry;			// Copy of the file's directory entry
+	uint32_t		HintIndex;		// Position in the cluster chain of HintCluster
+	uint32_t		HintCluster;	// Last cluster read, or 0
+	Spinlock		HintLock;		// Keeps HintIndex and HintCluster in step
 };
 
+
+// Results of directoryIndexLookup (see dirindex.c)
+
+#define DIRINDEX_NOT_INDEXED	-1
+#define DIRINDEX_NOT_FOUND		0
+#define DIRINDEX_FOUND			1
@@ -0,0 +1,82 @@
+// Fast user-space locking.
+//
+// A futex is an aligned int in user memory.  User code does its locking on
+// the int with atomic instructions, and only asks the kernel for help when
+// it has to wait or has to wake a waiter.  futexWait sleeps only if the int
+// still holds the value the caller last saw, checked under futexLock, and
+// futexWake takes the same lock, so a wakeup cannot slip in between the
+// check and the sleep.  Waiters sleep on the kernel address of the int, so
+// the threads of a process, which share its memory, find the same channel.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+
+static Spinlock futexLock;
+
+void futexInitialise(void)
+{
+	spinlockInitialise(&futexLock, "futex");
+}
+
+// Return the kernel address of a futex in the current process, or 0 if
+// it is not an aligned address in user memory.  The caller has checked
+// that it lies inside the process.
+
+static volatile int * futexKernelAddress(int * address)
+{
+	char * page;
+
+	if ((uint32_t)address & (sizeof(int) - 1))
+	{
+		return 0;
+	}
+	page = mapVirtualAddressToKernelAddress(myProcess()->PageTable, (char *)address);
+	if (page == 0)
+	{
+		return 0;
+	}
+	return (volatile int *)(page + ((uint32_t)address & (PGSIZE - 1)));
+}
+
+// Sleep until woken by futexWake, if *address == value.  Returns 0 if it
+// slept and -1 if *address had already changed.
+
+int futexWait(int * address, int value)
+{
+	volatile int * futex = futexKernelAddress(address);
+
+	if (futex == 0)
+	{
+		return -1;
+	}
+	spinlockAcquire(&futexLock);
+	if (*futex != value)
+	{
+		spinlockRelease(&futexLock);
+		return -1;
+	}
+	sleep((void *)futex, &futexLock);
+	spinlockRelease(&futexLock);
+	return 0;
+}
+
+// Wake up to count threads sleeping on address.  Returns the number woken.
+
+int futexWake(int * address, int count)
+{
+	volatile int * futex = futexKernelAddress(address);
+	int woken;
+
+	if (futex == 0)
+	{
+		return -1;
+	}
+	spinlockAcquire(&futexLock);
+	woken = wakeupCount((void *)futex, count);
+	spinlockRelease(&futexLock);
+	return woken;
+}
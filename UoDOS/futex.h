@@ -0,0 +1,5 @@
+// Operations for the futex system call
+
+#define FUTEX_WAIT		0		// Sleep if *address still equals value
+#define FUTEX_WAKE		1		// Wake up to value threads sleeping on address
+
@@ -12,6 +12,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "perf.h"
 
 #define SECTOR_SIZE		512
 
@@ -110,11 +111,13 @@ static void ideStartRequest(DiskBuffer *b)
 	outputByteToPort(0x1f6, 0xe0 | ((b->Device&1)<<4) | ((sector>>24)&0x0f));
 	if(b->Flags & B_DIRTY)
 	{
+		perfCount(PERF_IDE_WRITES);
 		outputByteToPort(0x1f7, writeCmd);
 		outputSequenceToPort(0x1f0, b->Data, BSIZE/4);
 	} 
 	else 
 	{
+		perfCount(PERF_IDE_READS);
 		outputByteToPort(0x1f7, readCmd);
 	}
 }
@@ -0,0 +1,309 @@
+// Initial ramdisk.
+//
+// The boot loader loads INITRD.CPI from the boot disk into conventional memory
+// straight after the kernel and passes its address in the BootInformation
+// structure.  The kernel never allocates memory below 1MB, so the archive can
+// be used where it is.  It is mounted read-only at /usrbin (see forkret in
+// proc.c), so init and the shell start without any disk I/O.  If there is no
+// ramdisk, /usrbin is read from the boot disk as before.
+//
+// The archive is in the cpio "newc" format: each file is a 110 byte header
+// of ASCII hex fields, followed by its name and its data, each padded to a
+// multiple of 4 bytes.  The archive ends with an entry called "TRAILER!!!".
+// Names are full paths within the archive (for example "sub/file.txt"), and
+// like FAT, they are matched without regard to case.
+//
+// The vnode id of a file is the offset of its header plus 1.  The root
+// directory, which has no header, has id 0.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "dirent.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "vfs.h"
+#include "bootinfo.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define tolower(c)	((c) >= 'A' && (c) <= 'Z' ? (c) + 'a' - 'A' : (c))
+#define toupper(c)	((c) >= 'a' && (c) <= 'z' ? (c) + 'A' - 'a' : (c))
+
+#define CPIO_HEADERSIZE		110
+#define CPIO_MODE_TYPE		0170000
+#define CPIO_MODE_DIRECTORY	0040000
+
+#define INITRD_ROOT_ID		0
+#define INITRD_END			0xFFFFFFFF		// Returned by initrdNextEntry at the end of the archive
+
+typedef struct _InitrdEntry
+{
+	const char *	Name;			// Path of the file within the archive (not NUL terminated)
+	uint32_t		NameLength;
+	const char *	Data;
+	uint32_t		Size;
+	short			Type;			// T_FILE or T_DIR
+} InitrdEntry;
+
+struct
+{
+	const char *	Archive;
+	uint32_t		Size;
+} initrd;
+
+// Record where the boot loader put the ramdisk, if it loaded one
+
+void initrdInitialise(BootInformation * bootInformation)
+{
+	if (bootInformation == 0 || bootInformation->Magic != BOOT_MAGIC || bootInformation->InitrdAddress == 0)
+	{
+		return;
+	}
+	if (bootInformation->InitrdSize < CPIO_HEADERSIZE || memcmp(P2V(bootInformation->InitrdAddress), "070701", 6) != 0)
+	{
+		cprintf("initrd: not a cpio archive\n");
+		return;
+	}
+	initrd.Archive = P2V(bootInformation->InitrdAddress);
+	initrd.Size = bootInformation->InitrdSize;
+}
+
+// Decode an 8 digit hex field from a header
+
+static uint32_t initrdHex(const char * field)
+{
+	uint32_t value = 0;
+
+	for (int i = 0; i < 8; i++)
+	{
+		char c = field[i];
+		value <<= 4;
+		if (c >= '0' && c <= '9')
+		{
+			value |= c - '0';
+		}
+		else if (c >= 'a' && c <= 'f')
+		{
+			value |= c - 'a' + 10;
+		}
+		else if (c >= 'A' && c <= 'F')
+		{
+			value |= c - 'A' + 10;
+		}
+	}
+	return value;
+}
+
+// Decode the header at offset.  Returns the offset of the next header, or
+// INITRD_END at the trailer or if the archive is damaged.
+
+static uint32_t initrdNextEntry(uint32_t offset, InitrdEntry * entry)
+{
+	const char * header = initrd.Archive + offset;
+
+	if (offset > initrd.Size - CPIO_HEADERSIZE || memcmp(header, "070701", 6) != 0)
+	{
+		return INITRD_END;
+	}
+	uint32_t mode = initrdHex(header + 14);
+	uint32_t size = initrdHex(header + 54);
+	uint32_t nameSize = initrdHex(header + 94);			// Includes the NUL
+	uint32_t dataOffset = (offset + CPIO_HEADERSIZE + nameSize + 3) & ~3;
+	if (nameSize == 0 || dataOffset > initrd.Size || size > initrd.Size - dataOffset)
+	{
+		return INITRD_END;
+	}
+	entry->Name = header + CPIO_HEADERSIZE;
+	entry->NameLength = nameSize - 1;
+	entry->Data = initrd.Archive + dataOffset;
+	entry->Size = size;
+	entry->Type = (mode & CPIO_MODE_TYPE) == CPIO_MODE_DIRECTORY ? T_DIR : T_FILE;
+	if (entry->NameLength == 10 && memcmp(entry->Name, "TRAILER!!!", 10) == 0)
+	{
+		return INITRD_END;
+	}
+	// Archives made with "find ." have names starting "./" and an entry for "."
+	if (entry->NameLength >= 2 && entry->Name[0] == '.' && entry->Name[1] == '/')
+	{
+		entry->Name += 2;
+		entry->NameLength -= 2;
+	}
+	while (entry->NameLength > 0 && *entry->Name == '/')
+	{
+		entry->Name++;
+		entry->NameLength--;
+	}
+	if (entry->NameLength == 1 && *entry->Name == '.')
+	{
+		entry->NameLength = 0;
+	}
+	return (dataOffset + size + 3) & ~3;
+}
+
+// Get the entry for a vnode other than the root
+
+static void initrdGetEntry(Vnode * vnode, InitrdEntry * entry)
+{
+	initrdNextEntry(vnode->Id - 1, entry);
+}
+
+// Does the entry's name start with the directory's path?  If so, set
+// *rest to the remainder of the name after the separator.
+
+static bool initrdInDirectory(InitrdEntry * directory, InitrdEntry * entry, const char ** rest, uint32_t * restLength)
+{
+	uint32_t prefix = directory ? directory->NameLength + 1 : 0;
+
+	if (entry->NameLength <= prefix)
+	{
+		return false;
+	}
+	if (directory && (memcmp(entry->Name, directory->Name, directory->NameLength) != 0 || entry->Name[directory->NameLength] != '/'))
+	{
+		return false;
+	}
+	*rest = entry->Name + prefix;
+	*restLength = entry->NameLength - prefix;
+	return true;
+}
+
+static int initrdMount(Mount * mount)
+{
+	Vnode root;
+
+	if (initrd.Archive == 0)
+	{
+		return -1;
+	}
+	memset(&root, 0, sizeof(Vnode));
+	root.Type = T_DIR;
+	mount->Root = vnodeGet(mount, INITRD_ROOT_ID, &root);
+	return mount->Root ? 0 : -1;
+}
+
+static int initrdLookup(Vnode * directory, const char * name, Vnode ** result)
+{
+	InitrdEntry directoryEntry;
+	InitrdEntry entry;
+	const char * rest;
+	uint32_t restLength;
+	uint32_t nameLength = strlen(name);
+	uint32_t offset;
+	uint32_t next;
+	Vnode vnode;
+
+	if (directory->Id != INITRD_ROOT_ID)
+	{
+		initrdGetEntry(directory, &directoryEntry);
+	}
+	for (offset = 0; (next = initrdNextEntry(offset, &entry)) != INITRD_END; offset = next)
+	{
+		if (!initrdInDirectory(directory->Id == INITRD_ROOT_ID ? 0 : &directoryEntry, &entry, &rest, &restLength) || restLength != nameLength)
+		{
+			continue;
+		}
+		uint32_t i;
+		for (i = 0; i < nameLength && tolower(rest[i]) == tolower(name[i]); i++)
+		{
+		}
+		if (i == nameLength)
+		{
+			memset(&vnode, 0, sizeof(Vnode));
+			vnode.Type = entry.Type;
+			vnode.Size = entry.Type == T_DIR ? 0 : entry.Size;
+			*result = vnodeGet(directory->Mount, offset + 1, &vnode);
+			return *result ? 0 : -1;
+		}
+	}
+	return -1;
+}
+
+static int initrdRead(Vnode * vnode, uint32_t position, char * buffer, uint32_t length)
+{
+	InitrdEntry entry;
+
+	if (vnode->Type != T_FILE)
+	{
+		return -1;
+	}
+	initrdGetEntry(vnode, &entry);
+	if (position >= entry.Size)
+	{
+		return 0;
+	}
+	length = min(length, entry.Size - position);
+	memmove(buffer, entry.Data + position, length);
+	return length;
+}
+
+// *position is the offset of the next header to look at
+
+static int initrdReadDirectory(Vnode * vnode, uint32_t * position, Dirent * dirents, int count)
+{
+	InitrdEntry directoryEntry;
+	InitrdEntry entry;
+	const char * rest;
+	uint32_t restLength;
+	uint32_t next;
+	int filled = 0;
+
+	if (vnode->Id != INITRD_ROOT_ID)
+	{
+		initrdGetEntry(vnode, &directoryEntry);
+	}
+	while (filled < count && (next = initrdNextEntry(*position, &entry)) != INITRD_END)
+	{
+		uint32_t offset = *position;
+		*position = next;
+		if (!initrdInDirectory(vnode->Id == INITRD_ROOT_ID ? 0 : &directoryEntry, &entry, &rest, &restLength))
+		{
+			continue;
+		}
+		// Only the directory's own entries, not those in its sub-directories
+		uint32_t i;
+		for (i = 0; i < restLength && rest[i] != '/'; i++)
+		{
+		}
+		if (i < restLength)
+		{
+			continue;
+		}
+		// Names are shown in upper case like FAT names, and truncated if too long
+		Dirent * dirent = &dirents[filled++];
+		uint32_t length = min(restLength, DIRENTNAMESIZE - 1);
+		for (i = 0; i < length; i++)
+		{
+			dirent->name[i] = toupper(rest[i]);
+		}
+		dirent->name[length] = 0;
+		dirent->attrib = ATTRIB_READONLY | (entry.Type == T_DIR ? ATTRIB_DIRECTORY : 0);
+		dirent->type = entry.Type;
+		dirent->ino = offset + 1;
+		dirent->size = entry.Type == T_DIR ? 0 : entry.Size;
+		dirent->mtime = 0;
+	}
+	return filled;
+}
+
+static int initrdStat(Vnode * vnode, Stat * st)
+{
+	st->type = vnode->Type;
+	st->ino = vnode->Id;
+	st->nlink = 1;
+	st->size = vnode->Size;
+	return 0;
+}
+
+FileSystemOperations initrdOperations =
+{
+	.Name = "initrd",
+	.Mount = initrdMount,
+	.Lookup = initrdLookup,
+	.Read = initrdRead,
+	.Write = 0,
+	.ReadDirectory = initrdReadDirectory,
+	.Stat = initrdStat,
+	.Release = 0,
+};
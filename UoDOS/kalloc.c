@@ -8,6 +8,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "perf.h"
 
 void freeMemoryRange(void *vstart, void *vend);
 extern char kernelEnd[]; // first address after kernel loaded from ELF file
@@ -74,6 +75,7 @@ void freePhysicalMemoryPage(char *v)
 	{
 		spinlockAcquire(&kernelMemory.Lock);
 	}
+	perfCount(PERF_PAGE_FREES);
 	r = (struct MemoryPage*)v;
 	r->Next = kernelMemory.FreeList;
 	kernelMemory.FreeList = r;
@@ -99,6 +101,7 @@ char* allocatePhysicalMemoryPage(void)
 	if (r)
 	{
 		kernelMemory.FreeList = r->Next;
+		perfCount(PERF_PAGE_ALLOCATIONS);
 	}
 	if (kernelMemory.UseLock)
 	{
@@ -5,6 +5,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
+#include "bootinfo.h"
 
 // This is a dummy __main.  For some reason, gcc puts in a call to 
 // __main from main, so we just include a dummy.
@@ -18,23 +19,33 @@ static void mpmain(void)  __attribute__((noreturn));
 
 extern char * kernelEnd; 
 
-void main() 
+void main(BootInformation * bootInformation) 
 {
+	stringInitialise();									// pick memmove strategy for this CPU
+	initrdInitialise(P2V(bootInformation));				// find the initial ramdisk passed by the boot loader
 	initialiseLowerkernelMemory((char *)&kernelEnd, P2V(4 * 1024 * 1024));	// phys page allocator
 	allocateKernelVirtualMemory();						// kernel page table
 	mpinit();											// detect other processors
 	localApicInitialise();								// interrupt controller
+	timerInitialise();									// calibrate the clock and local APIC timer
 	initialiseGDT();									// segment descriptors
 	picInitialise();									// disable pic
 	ioApicInitialise();									// another interrupt controller
 	consoleInitialise();								// console hardware
 	//uartinit();										// serial port
-	processTableInitialise();							// process table
+	processTableInitialise(P2V(bootInformation));		// process table
+	futexInitialise();									// user-space lock wait queues
 	trapVectorsInitialise();							// trap vectors
 	diskBufferCacheInitialise();						// buffer cache
 	filesInitialise();									// file table
+	vfsInitialise();									// mount table and vnode cache
+	fsFatInitialise();									// FAT file system
+	tmpfsInitialise();									// in-memory file system
 	ideInitialise();									// disk 
 	initialiseRestOfkernelMemory(P2V(4 * 1024 * 1024), P2V(PHYSTOP));			// must come after startothers()
+#ifdef STRING_SELF_TEST
+	stringSelfTest();									// check and time memmove etc.
+#endif
 	initialiseFirstUserProcess();						// first user process
 	mpmain();											// finish this processor's setup
 }
@@ -45,5 +56,6 @@ static void mpmain(void)
 	cprintf("cpu%d: starting %d\n", cpuId(), cpuId());
 	interruptDescriptorTableInitialise();       
 	atomicExchange(&(myCpu()->Started), 1); // tell startothers() we're up
+	timerStart();								// first time slice
 	scheduler();    
 }
\ No newline at end of file
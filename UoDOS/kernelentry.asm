@@ -7,6 +7,7 @@ bits 32
 extern _main
 	; Setup stack for kernel
 	mov		esp, stack + 4096
+	push	ebx						; The boot loader passes the address of the boot information in EBX
 	call	_main
 	
 	; We should never get back here
@@ -58,13 +58,12 @@ void localApicInitialise(void)
 	// Enable local APIC; set spurious interrupt vector.
 	localApicWrite(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-	// The timer repeatedly counts down at bus frequency
-	// from localApic[TICR] and then issues an interrupt.
-	// If xv6 cared more about precise timekeeping,
-	// TICR would be calibrated using an external time source.
+	// The timer counts down once at bus frequency from localApic[TICR]
+	// and then issues an interrupt.  timer.c calibrates it against the
+	// PIT and sets the count for each deadline, so it is left stopped here.
 	localApicWrite(TDCR, X1);
-	localApicWrite(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-	localApicWrite(TICR, 10000000);
+	localApicWrite(TIMER, T_IRQ0 + IRQ_TIMER);
+	localApicWrite(TICR, 0);
 
 	// Disable logical interrupt lines.
 	localApicWrite(LINT0, MASKED);
@@ -105,6 +104,38 @@ int localApicId(void)
 	return localApic[ID] >> 24;
 }
 
+// Start the timer counting down from count, or stop it if count is 0.
+// It interrupts once when the count reaches 0.
+
+void localApicSetTimer(uint32_t count)
+{
+	if (localApic)
+	{
+		localApicWrite(TICR, count);
+	}
+}
+
+// Send an interrupt with the given vector to another CPU
+
+void localApicSendInterrupt(uint8_t apicid, int vector)
+{
+	if (!localApic)
+	{
+		return;
+	}
+	localApicWrite(ICRHI, apicid << 24);
+	localApicWrite(ICRLO, FIXED | vector);
+	while (localApic[ICRLO] & DELIVS)
+		;
+}
+
+// Read the timer's current count
+
+uint32_t localApicTimerCount(void)
+{
+	return localApic ? localApic[TCCR] : 0;
+}
+
 // Acknowledge interrupt.
 void localApicEndOfInterrupt(void)
 {
@@ -0,0 +1,135 @@
+// Lock contention profiler.
+//
+// Build with -DLOCK_PROFILE to use it.  Every spinlock and sleeplock is then
+// given a slot in a table when it is initialised, one slot for each lock name,
+// so all the locks with the same name (all the pipe locks, say) are counted
+// together.  For each name, it counts how many times the locks were acquired,
+// how many of those times had to wait because another CPU or process held the
+// lock, how long was spent waiting and the longest time a lock was held.
+// Times are measured with the time stamp counter.  Type ^L on the console
+// to print the table.
+//
+// Like the performance counters, each CPU has its own copy of the figures and
+// only updates its own, so they can be updated with interrupts off and no lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+
+typedef struct _LockProfile
+{
+	uint32_t			Acquires;		// Number of times the lock was acquired
+	uint32_t			Contended;		// Number of those that had to wait for the lock
+	uint64_t			WaitCycles;		// Time stamp counter cycles spent waiting
+	uint64_t			MaxHoldCycles;	// Longest time the lock was held
+} LockProfile;
+
+static struct
+{
+	char *				Name;
+	int					Sleeping;		// Is it a sleeplock?
+} lockNames[NLOCKPROFILE];
+
+static struct
+{
+	LockProfile			Locks[NLOCKPROFILE];
+} __attribute__((aligned(64))) perCpu[NCPU];
+
+// Find or add the slot for a lock name.  Returns the slot number + 1, or 0
+// if the table is full (the lock is then not profiled).  Locks can be
+// initialised on more than one CPU at once, so new names are added with
+// an atomic compare and exchange rather than a lock.
+
+int lockProfileRegister(char * name, int sleeping)
+{
+	for (int i = 0; i < NLOCKPROFILE; i++)
+	{
+		char * slotName = lockNames[i].Name;
+		if (slotName == 0)
+		{
+			slotName = __sync_val_compare_and_swap(&lockNames[i].Name, 0, name);
+			if (slotName == 0)
+			{
+				lockNames[i].Sleeping = sleeping;
+				return i + 1;
+			}
+		}
+		if (lockNames[i].Sleeping == sleeping && strcmp(slotName, name) == 0)
+		{
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+// Record that a lock was acquired after waiting for the given number
+// of cycles.  Interrupts must be disabled.
+
+void lockProfileAcquire(int slot, uint64_t waitCycles)
+{
+	if (slot == 0)
+	{
+		return;
+	}
+	LockProfile * profile = &perCpu[cpuId()].Locks[slot - 1];
+	profile->Acquires++;
+	if (waitCycles)
+	{
+		profile->Contended++;
+		profile->WaitCycles += waitCycles;
+	}
+}
+
+// Record that a lock was released after being held for the given number
+// of cycles.  Interrupts must be disabled.
+
+void lockProfileRelease(int slot, uint64_t heldCycles)
+{
+	if (slot == 0)
+	{
+		return;
+	}
+	LockProfile * profile = &perCpu[cpuId()].Locks[slot - 1];
+	if (heldCycles > profile->MaxHoldCycles)
+	{
+		profile->MaxHoldCycles = heldCycles;
+	}
+}
+
+// Print the figures for each lock name, adding up the CPUs.  The cycle
+// counts are shown in units of 1024 cycles since cprintf cannot print
+// 64-bit numbers.  Runs when the user types ^L on the console.
+
+void lockProfileDump(void)
+{
+#ifndef LOCK_PROFILE
+	cprintf("\nLock profiling is off.  Build the kernel with -DLOCK_PROFILE to turn it on.\n");
+#else
+	cprintf("\nlock\t\ttype\tacquires\tcontended\twait/1K cycles\tmax hold/1K cycles\n");
+	for (int i = 0; i < NLOCKPROFILE && lockNames[i].Name != 0; i++)
+	{
+		LockProfile total = { 0 };
+		for (int cpu = 0; cpu < NCPU; cpu++)
+		{
+			volatile LockProfile * profile = &perCpu[cpu].Locks[i];
+			total.Acquires += profile->Acquires;
+			total.Contended += profile->Contended;
+			total.WaitCycles += profile->WaitCycles;
+			if (profile->MaxHoldCycles > total.MaxHoldCycles)
+			{
+				total.MaxHoldCycles = profile->MaxHoldCycles;
+			}
+		}
+		cprintf("%s\t%s%s\t%d\t\t%d\t\t%d\t\t%d\n",
+				lockNames[i].Name,
+				strlen(lockNames[i].Name) < 8 ? "\t" : "",
+				lockNames[i].Sleeping ? "sleep" : "spin",
+				total.Acquires,
+				total.Contended,
+				(uint32_t)(total.WaitCycles >> 10),
+				(uint32_t)(total.MaxHoldCycles >> 10));
+	}
+#endif
+}
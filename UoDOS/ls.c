@@ -0,0 +1,54 @@
+// ls: List the contents of a directory.  Usage: ls [directory]
+
+#include "types.h"
+#include "stat.h"
+#include "dirent.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define BATCHSIZE 32
+
+static struct _Dirent dirents[BATCHSIZE];
+
+int main(int argc, char *argv[])
+{
+	char path[200];
+	int fd;
+	int count;
+
+	if (argc > 1)
+	{
+		strcpy(path, argv[1]);
+	}
+	else if (getcwd(path, sizeof(path)) < 0)
+	{
+		printf("ls: cannot get current directory\n");
+		exit();
+	}
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		printf("ls: cannot open %s\n", path);
+		exit();
+	}
+	while ((count = getdents(fd, dirents, BATCHSIZE)) > 0)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			if (dirents[i].type == T_DIR)
+			{
+				printf("%s <DIR>\n", dirents[i].name);
+			}
+			else
+			{
+				printf("%s %d\n", dirents[i].name, dirents[i].size);
+			}
+		}
+	}
+	if (count < 0)
+	{
+		printf("ls: %s is not a directory\n", path);
+	}
+	close(fd);
+	exit();
+}
@@ -0,0 +1,65 @@
+;	Decompress a kernel image compressed by tools/lz4pack
+
+bits	32
+
+; Magic number at the start of a compressed kernel ("LZ4K")
+%define		KERNEL_LZ4_MAGIC	4B345A4Ch
+
+; Decompress an LZ4 block.  Each sequence in the block is a token byte, the
+; literal bytes and then a match (an offset back into the output and a length).
+; The high 4 bits of the token hold the literal length and the low 4 bits the
+; match length - 4.  A length of 15 is followed by bytes to add to it, up to
+; and including the first byte that is not 255.  The last sequence has no match.
+;
+; Input:  ESI = Compressed block
+;		  ECX = Size of compressed block
+;		  EDI = Where to decompress to
+
+Lz4Decompress:
+	pusha
+	cld
+	lea		edx, [esi + ecx]				; EDX = End of compressed block
+
+Lz4_Sequence:
+	xor		eax, eax
+	lodsb									; Get the token
+	mov		ebx, eax
+	shr		eax, 4							; Literal length
+	call	Lz4_Length
+	mov		ecx, eax						; Copy the literals
+	rep		movsb
+	cmp		esi, edx						; The last sequence has no match
+	jae		Lz4_Done
+
+	mov		eax, ebx						; Match length - 4
+	and		eax, 0Fh
+	movzx	ebx, word [esi]					; Offset of match back from the current output position
+	add		esi, 2
+	call	Lz4_Length
+	lea		ecx, [eax + 4]
+	push	esi
+	mov		esi, edi
+	sub		esi, ebx
+	rep		movsb							; Copy the match. This must be a byte at a time since it can overlap the output
+	pop		esi
+	jmp		Lz4_Sequence
+
+Lz4_Done:
+	popa
+	ret
+
+; Add any extra length bytes at ESI to the length in EAX
+
+Lz4_Length:
+	cmp		eax, 15
+	jne		Lz4_Length_Done
+
+Lz4_Length_Loop:
+	movzx	ecx, byte [esi]
+	inc		esi
+	add		eax, ecx
+	cmp		ecx, 255
+	je		Lz4_Length_Loop
+
+Lz4_Length_Done:
+	ret
@@ -0,0 +1,90 @@
+// mbench: Time the user-space memory allocator.
+//
+// Runs a series of allocation patterns and reports the number of clock ticks
+// each one took.  Usage: mbench [iterations]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NSLOTS	256
+
+static void* slots[NSLOTS];
+
+// Allocate and immediately free blocks of a single size
+
+static void benchSameSize(int iterations, uint32_t size)
+{
+	int start = uptime();
+	for (int i = 0; i < iterations; i++)
+	{
+		void *p = malloc(size);
+		if (p == 0)
+		{
+			printf("mbench: out of memory\n");
+			exit();
+		}
+		free(p);
+	}
+	printf("malloc/free %d bytes x %d: %d ticks\n", size, iterations, uptime() - start);
+}
+
+// Keep a pool of live blocks of varying sizes, replacing one on each step
+
+static void benchMixed(int iterations, uint32_t maxSize)
+{
+	uint32_t seed = 1;
+	int start = uptime();
+
+	for (int i = 0; i < iterations; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		int slot = (seed >> 16) % NSLOTS;
+		if (slots[slot])
+		{
+			free(slots[slot]);
+		}
+		slots[slot] = malloc(1 + (seed >> 8) % maxSize);
+		if (slots[slot] == 0)
+		{
+			printf("mbench: out of memory\n");
+			exit();
+		}
+	}
+	for (int i = 0; i < NSLOTS; i++)
+	{
+		free(slots[i]);
+		slots[i] = 0;
+	}
+	printf("mixed sizes up to %d x %d: %d ticks\n", maxSize, iterations, uptime() - start);
+}
+
+// Check that freeing large blocks gives memory back to the kernel
+
+static void benchRelease(void)
+{
+	char *before = sbrk(0);
+	void *p = malloc(256 * 1024);
+	char *during = sbrk(0);
+	free(p);
+	char *after = sbrk(0);
+	printf("large block: break grew by %d, %d left after free\n", during - before, after - before);
+}
+
+int main(int argc, char *argv[])
+{
+	int iterations = 100000;
+
+	if (argc > 1)
+	{
+		iterations = atoi(argv[1]);
+	}
+	benchSameSize(iterations, 16);
+	benchSameSize(iterations, 200);
+	benchSameSize(iterations, 2000);
+	benchSameSize(iterations / 10, 16384);
+	benchMixed(iterations, 512);
+	benchMixed(iterations / 10, 8192);
+	benchRelease();
+	exit();
+}
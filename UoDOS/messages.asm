@@ -8,6 +8,7 @@ a20_msg_four		db 'A20 line enabled using Fast A20 gate', 0
 no_a20_msg			db 'Unable to enable A20 line', 0	
 wait_for_key_msg    db 'Press a key to continue', 0
 msgFailure 	  	    db 'Unable to find KERNEL.SYS. ', 0
+msgNoInitrd			db 'Unable to load INITRD.CPI', 0
 
 
 a20_message_list	dw no_a20_msg
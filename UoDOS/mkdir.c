@@ -0,0 +1,24 @@
+// mkdir: Create directories.  Usage: mkdir directory...
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	if (argc < 2)
+	{
+		printf("usage: mkdir directory...\n");
+		exit();
+	}
+	for (i = 1; i < argc; i++)
+	{
+		if (mkdir(argv[i]) < 0)
+		{
+			printf("mkdir: cannot create %s\n", argv[i]);
+		}
+	}
+	exit();
+}
@@ -1,4 +1,4 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC      1024  // default maximum number of processes (see BootInformation.MaxProcesses)
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
@@ -9,5 +9,11 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define MAXFATSIZE	 10 // Maximum number of sectors occupied by a FAT
 #define MAXCWDSIZE	 200 // Maximum length of current working directory in process structure
+#define NDIRINDEX	 8   // Maximum number of directories with an in-memory hash index
+#define NMOUNT		 8   // Maximum number of mounted file systems
+#define NVNODE		 64  // Size of the vnode cache
+#define NLOCKPROFILE	 32  // Number of lock names the lock profiler can keep figures for
+#define NPIDHASH	 256 // Number of chains in the process ID hash table (a power of 2)
+#define TIMESLICE	 10000000  // Nanoseconds a process runs before the timer preempts it
+#define TICKSPERSECOND	 100 // Units of the sleep and uptime system calls
@@ -0,0 +1,73 @@
+// Performance counters.
+//
+// Each CPU has its own set of counters, on its own cache lines, and only
+// ever updates its own.  So incrementing a counter needs no lock, just
+// interrupts turned off so that the process is not moved to another CPU
+// half way through.  perfRead adds up the counters of all the CPUs.  It
+// may see some of them a moment out of date, but never a torn value.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "perf.h"
+
+static struct
+{
+	PerfCounters	Counters;
+} __attribute__((aligned(64))) perCpu[NCPU];
+
+// Count an event on CPU cpu.  Interrupts must be disabled.
+
+void perfCountOn(int cpu, int counter, uint32_t amount)
+{
+	perCpu[cpu].Counters.Counters[counter] += amount;
+}
+
+// Count an event on this CPU
+
+void perfCount(int counter)
+{
+	// Before the processors have been found, there is no way of telling which
+	// one we are on.  Only the boot processor is running then, so use its counters.
+	if (ncpu == 0)
+	{
+		perCpu[0].Counters.Counters[counter]++;
+		return;
+	}
+	pushCli();
+	perCpu[cpuId()].Counters.Counters[counter]++;
+	popCli();
+}
+
+void perfCountSyscall(int number)
+{
+	pushCli();
+	int cpu = cpuId();
+	perCpu[cpu].Counters.Counters[PERF_SYSCALLS]++;
+	if (number >= 0 && number < PERF_MAXSYSCALLS)
+	{
+		perCpu[cpu].Counters.Syscalls[number]++;
+	}
+	popCli();
+}
+
+// Add up the counters of all the CPUs
+
+void perfRead(PerfCounters * total)
+{
+	memset(total, 0, sizeof(PerfCounters));
+	for (int cpu = 0; cpu < NCPU; cpu++)
+	{
+		volatile PerfCounters * counters = &perCpu[cpu].Counters;
+		for (int i = 0; i < NPERFCOUNTERS; i++)
+		{
+			total->Counters[i] += counters->Counters[i];
+		}
+		for (int i = 0; i < PERF_MAXSYSCALLS; i++)
+		{
+			total->Syscalls[i] += counters->Syscalls[i];
+		}
+	}
+}
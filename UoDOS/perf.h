@@ -0,0 +1,25 @@
+// Kernel performance counters (see perf.c), read with the getcounters system call
+
+#define PERF_BUFFER_HITS		0	// diskBufferRead found the sector in the buffer cache
+#define PERF_BUFFER_MISSES		1	// diskBufferRead had to recycle a buffer
+#define PERF_IDE_READS			2	// Read requests sent to the IDE controller
+#define PERF_IDE_WRITES			3	// Write requests sent to the IDE controller
+#define PERF_CONTEXT_SWITCHES	4	// Switches from the scheduler to a process
+#define PERF_SYSCALLS			5	// System calls (all numbers)
+#define PERF_PAGE_ALLOCATIONS	6	// Pages handed out by allocatePhysicalMemoryPage
+#define PERF_PAGE_FREES			7	// Pages returned by freePhysicalMemoryPage
+#define PERF_LOCK_ACQUIRES		8	// Spinlocks acquired
+#define PERF_LOCK_SPINS			9	// Times round the loop waiting for a spinlock that was held
+#define PERF_IDLE_HALTS			10	// Times the scheduler halted with nothing to run
+#define NPERFCOUNTERS			11
+
+#define PERF_MAXSYSCALLS		32	// System calls are also counted by number, up to this number
+
+// Counters wrap around, so differences between two readings are only
+// meaningful as unsigned values
+
+struct _PerfCounters
+{
+	uint32_t	Counters[NPERFCOUNTERS];
+	uint32_t	Syscalls[PERF_MAXSYSCALLS];
+};
@@ -3,8 +3,8 @@
 #include "param.h"
 #include "mmu.h"
 #include "proc.h"
-#include "fs.h"
 #include "spinlock.h"
+#include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
 
@@ -5,14 +5,29 @@
 #include "mmu.h"
 #include "x86.h"
 #include "proc.h"
+#include "spinlock.h"
 #include "fs.h"
 #include "file.h"
-#include "spinlock.h"
+#include "perf.h"
+#include "bootinfo.h"
+#include "traps.h"
+
+// Process structures are allocated a page at a time, up to a limit set at
+// boot, and are never freed.  All the structures are on one list, and the
+// unused ones are also on a free list, so creating a process does not have
+// to look for a free slot.  The lock also protects the process ID hash table
+// and the Parent, Children and Sibling links, which let kill, wait and exit
+// find a process or a process's children without looking at every process.
 
 struct 
 {
 	Spinlock		Lock;
-	Process			Process[NPROC];
+	Process *		All;				// All the process structures
+	Process *		Free;				// The unused ones
+	uint32_t		Count;				// Number of process structures allocated
+	uint32_t		Limit;				// Maximum number of process structures
+	Process *		PidHash[NPIDHASH];
+	ThreadGroup *	FreeGroups;			// Unused thread groups
 } processTable;
 
 static Process *initproc;
@@ -23,9 +38,14 @@ extern void trapret(void);
 
 static void wakeup1(void *chan);
 
-void processTableInitialise(void)
+void processTableInitialise(BootInformation * bootInformation)
 {
 	spinlockInitialise(&processTable.Lock, "processTable");
+	processTable.Limit = NPROC;
+	if (bootInformation != 0 && bootInformation->Magic == BOOT_MAGIC && bootInformation->MaxProcesses != 0)
+	{
+		processTable.Limit = bootInformation->MaxProcesses;
+	}
 }
 
 // Must be called with interrupts disabled
@@ -73,7 +93,145 @@ Process* myProcess(void)
 	return p;
 }
 
-// Look in the process table for an UNUSED Process.
+#define PIDHASH(pid)	((uint32_t)(pid) & (NPIDHASH - 1))
+
+// Find the process with a process ID.  Must hold processTable.Lock.
+
+static Process* findProcess(int pid)
+{
+	Process *p;
+
+	for (p = processTable.PidHash[PIDHASH(pid)]; p != 0; p = p->HashNext)
+	{
+		if (p->ProcessId == pid)
+		{
+			return p;
+		}
+	}
+	return 0;
+}
+
+// Take a process out of the process ID hash table and mark its slot
+// free.  Must hold processTable.Lock.
+
+static void releaseProcessSlot(Process *p)
+{
+	Process **link = &processTable.PidHash[PIDHASH(p->ProcessId)];
+
+	while (*link != p)
+	{
+		link = &(*link)->HashNext;
+	}
+	*link = p->HashNext;
+	p->HashNext = 0;
+	p->ProcessId = 0;
+	p->State = UNUSED;
+	p->NextFree = processTable.Free;
+	processTable.Free = p;
+}
+
+// Make a process runnable and, if another CPU is halted with nothing to
+// run, interrupt it so that it runs the process now rather than at its
+// next timer.  One CPU is enough for one process.  The scheduler marks a
+// CPU idle before it releases processTable.Lock, so a CPU cannot miss a
+// process made runnable after it last looked.  Must hold processTable.Lock.
+
+static void makeRunnable(Process *p)
+{
+	int self = cpuId();
+
+	p->State = RUNNABLE;
+	for (int i = 0; i < ncpu; i++)
+	{
+		if (i != self && cpus[i].Idle)
+		{
+			cpus[i].Idle = 0;
+			localApicSendInterrupt(cpus[i].Apicid, T_IRQ0 + IRQ_WAKEUP);
+			return;
+		}
+	}
+}
+
+// Take an unused thread group from the free list, carving a page into
+// more if there are none.  There is never more than one per process, so
+// the process limit also limits these.  Must hold processTable.Lock.
+
+static ThreadGroup* allocateThreadGroup(void)
+{
+	ThreadGroup *group = processTable.FreeGroups;
+
+	if (group == 0)
+	{
+		group = (ThreadGroup *)allocatePhysicalMemoryPage();
+		if (group == 0)
+		{
+			return 0;
+		}
+		for (int i = 0; i < PGSIZE / sizeof(ThreadGroup); i++)
+		{
+			group[i].NextFree = processTable.FreeGroups;
+			processTable.FreeGroups = &group[i];
+		}
+		group = processTable.FreeGroups;
+	}
+	processTable.FreeGroups = group->NextFree;
+	memset(group, 0, sizeof(ThreadGroup));
+	group->Threads = 1;
+	group->ReferenceCount = 1;
+	return group;
+}
+
+// Free a zombie process that has been waited for, and its memory if it was
+// the last thread using it.  Returns its process ID.  The caller must have
+// taken it off its parent's list of children and must hold processTable.Lock.
+
+static int reapProcess(Process *p)
+{
+	int pid = p->ProcessId;
+
+	freePhysicalMemoryPage(p->KernelStack);
+	p->KernelStack = 0;
+	if (--p->Group->ReferenceCount == 0)
+	{
+		freeMemoryAndPageTable(p->PageTable);
+		p->Group->NextFree = processTable.FreeGroups;
+		processTable.FreeGroups = p->Group;
+	}
+	p->PageTable = 0;
+	p->Group = 0;
+	p->Parent = 0;
+	p->Sibling = 0;
+	p->Name[0] = 0;
+	p->IsKilled = 0;
+	releaseProcessSlot(p);
+	return pid;
+}
+
+// Add a page of process structures to the process table, or as many as
+// the limit allows.  Must hold processTable.Lock.
+
+static void growProcessTable(void)
+{
+	Process *p = (Process *)allocatePhysicalMemoryPage();
+
+	if (p == 0)
+	{
+		return;
+	}
+	memset(p, 0, PGSIZE);
+	for (int i = 0; i < PGSIZE / sizeof(Process) && processTable.Count < processTable.Limit; i++, p++)
+	{
+		p->NextFree = processTable.Free;
+		processTable.Free = p;
+		p->Next = processTable.All;
+		// processDump follows the list without the lock, so the link must be set first
+		__sync_synchronize();
+		processTable.All = p;
+		processTable.Count++;
+	}
+}
+
+// Take an UNUSED Process from the free list, adding more if there are none.
 // If found, change state to EMBRYO and initialize
 // state required to run in the kernel.
 // Otherwise return 0.
@@ -82,35 +240,33 @@ static Process* allocateProcess(void)
 {
 	Process *p;
 	char *sp;
-	int found = 0;
 
 	spinlockAcquire(&processTable.Lock);
-	p = processTable.Process;
-	while (p < &processTable.Process[NPROC] && !found)
+	if (processTable.Free == 0 && processTable.Count < processTable.Limit)
 	{
-		if (p->State == UNUSED)
-		{
-			found = 1;
-		}
-		else
-		{
-			p++;
-		}
+		growProcessTable();
 	}
-	if (!found)
+	p = processTable.Free;
+	if (p == 0)
 	{
 		spinlockRelease(&processTable.Lock);
 		return 0;
 	}
+	processTable.Free = p->NextFree;
+	p->NextFree = 0;
 	p->State = EMBRYO;
 	p->ProcessId = nextpid++;
+	p->HashNext = processTable.PidHash[PIDHASH(p->ProcessId)];
+	processTable.PidHash[PIDHASH(p->ProcessId)] = p;
 
 	spinlockRelease(&processTable.Lock);
 
 	// Allocate kernel stack.
 	if ((p->KernelStack = allocatePhysicalMemoryPage()) == 0) 
 	{
-		p->State = UNUSED;
+		spinlockAcquire(&processTable.Lock);
+		releaseProcessSlot(p);
+		spinlockRelease(&processTable.Lock);
 		return 0;
 	}
 	sp = p->KernelStack + KSTACKSIZE;
@@ -128,17 +284,6 @@ static Process* allocateProcess(void)
 	p->Context = (Context*)sp;
 	memset(p->Context, 0, sizeof *p->Context);
 	p->Context->eip = (uint32_t)forkret;
-
-	// Allocate the stdin, stdout and stderr devices
-
-	File * consoleDevice = allocateFileStructure();
-	consoleDevice->Type = FD_DEVICE;
-	consoleDevice->DeviceID = CONSOLE;
-	consoleDevice->Readable = 1;
-	consoleDevice->Writable = 1;
-	p->OpenFile[0] = consoleDevice;
-	p->OpenFile[1] = fileDup(consoleDevice);
-	p->OpenFile[2] = fileDup(consoleDevice);
  	return p;
 }
 
@@ -152,12 +297,28 @@ void initialiseFirstUserProcess(void)
 	p = allocateProcess();
 
 	initproc = p;
-	if ((p->PageTable = setupKernelVirtualMemory()) == 0)
+	spinlockAcquire(&processTable.Lock);
+	p->Group = allocateThreadGroup();
+	spinlockRelease(&processTable.Lock);
+	if (p->Group == 0 || (p->PageTable = setupKernelVirtualMemory()) == 0)
 	{
 		panic("initialiseFirstUserProcess: out of memory?");
 	}
 	initialiseUserVirtualMemory(p->PageTable, initcode_start, (int)(initcode_end - initcode_start));
-	p->MemorySize = PGSIZE;
+	p->Group->MemorySize = PGSIZE;
+	p->Group->MappedSize = PGSIZE;
+	p->Group->Leader = p;
+
+	// Allocate the stdin, stdout and stderr devices.  Every other process
+	// inherits them.
+	File * consoleDevice = allocateFileStructure();
+	consoleDevice->Type = FD_DEVICE;
+	consoleDevice->DeviceID = CONSOLE;
+	consoleDevice->Readable = 1;
+	consoleDevice->Writable = 1;
+	p->Group->OpenFile[0] = consoleDevice;
+	p->Group->OpenFile[1] = fileDup(consoleDevice);
+	p->Group->OpenFile[2] = fileDup(consoleDevice);
 	memset(p->Trapframe, 0, sizeof(*p->Trapframe));
 	p->Trapframe->cs = (SEG_UCODE << 3) | DPL_USER;
 	p->Trapframe->ds = (SEG_UDATA << 3) | DPL_USER;
@@ -176,37 +337,121 @@ void initialiseFirstUserProcess(void)
 	// because the assignment might not be atomic.
 	spinlockAcquire(&processTable.Lock);
 
-	p->State = RUNNABLE;
+	makeRunnable(p);
+
+	spinlockRelease(&processTable.Lock);
+}
 
+// Take the right to change or copy a thread group's memory, since its threads
+// share the memory size.  This sleeps rather than spins, because shrinking
+// waits for other CPUs to flush their TLBs.
+
+static void lockGroupMemory(ThreadGroup *group)
+{
+	spinlockAcquire(&processTable.Lock);
+	while (group->Growing)
+	{
+		sleep(&group->Growing, &processTable.Lock);
+	}
+	group->Growing = 1;
 	spinlockRelease(&processTable.Lock);
 }
 
+static void unlockGroupMemory(ThreadGroup *group)
+{
+	spinlockAcquire(&processTable.Lock);
+	group->Growing = 0;
+	wakeup1(&group->Growing);
+	spinlockRelease(&processTable.Lock);
+}
+
+// Unmap the memory that a shrink left mapped above the memory size, unless a
+// system call that may have checked a pointer into it is still running.
+// active is the number of system calls that the caller is in itself (which
+// do not use that memory).  Must have locked the group's memory.
+
+static void releaseShrunkMemory(Process *p, int active)
+{
+	ThreadGroup *group = p->Group;
+
+	if (group->MappedSize > group->MemorySize && group->SyscallsActive == active)
+	{
+		releaseUserPages(p->PageTable, group->MappedSize, group->MemorySize);
+		group->MappedSize = group->MemorySize;
+	}
+}
+
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size on success, -1 on failure.
+//
+// Other threads may be in system calls using pointers that they have checked
+// against the old size, so when the memory shrinks, the pages are only
+// unmapped once those calls have finished (see endSystemCall).  Until then
+// MappedSize stays above MemorySize, and growing again reuses them.
 
 int growProcess(int n)
 {
+	uint32_t oldSize;
 	uint32_t memorySize;
 	Process *curproc = myProcess();
+	ThreadGroup *group = curproc->Group;
 
-	memorySize = curproc->MemorySize;
+	lockGroupMemory(group);
+	oldSize = memorySize = group->MemorySize;
 	if (n > 0) 
 	{
-		if ((memorySize = allocateMemoryAndPageTables(curproc->PageTable, memorySize, memorySize + n)) == 0)
+		// Clear any pages kept from a shrink, as if they were new
+		memset((char*)PGROUNDUP(oldSize), 0, PGROUNDUP(group->MappedSize) - PGROUNDUP(oldSize));
+		memorySize = oldSize + n;
+		if (memorySize > group->MappedSize)
 		{
-			return -1;
+			if (allocateMemoryAndPageTables(curproc->PageTable, group->MappedSize, memorySize) == 0)
+			{
+				memorySize = 0;
+			}
+			else
+			{
+				group->MappedSize = memorySize;
+			}
 		}
 	}
-	else if (n < 0) 
+	else if (n < 0 && oldSize + n < oldSize) 
 	{
-		if ((memorySize = releaseUserPages(curproc->PageTable, memorySize, memorySize + n)) == 0)
-		{
-			return -1;
-		}
+		memorySize = oldSize + n;
+	}
+	if (memorySize == 0)
+	{
+		unlockGroupMemory(group);
+		return -1;
+	}
+	group->MemorySize = memorySize;
+	// Make the new size visible before looking for other system calls, so
+	// that any call that starts after this checks pointers against it
+	__sync_synchronize();
+	releaseShrunkMemory(curproc, 1);
+	unlockGroupMemory(group);
+	return oldSize;
+}
+
+// Count the current thread in and out of a system call.  The last thread in
+// the group to leave one unmaps any memory left mapped by a shrink.
+
+void beginSystemCall(void)
+{
+	__sync_fetch_and_add(&myProcess()->Group->SyscallsActive, 1);
+}
+
+void endSystemCall(void)
+{
+	Process *curproc = myProcess();
+	ThreadGroup *group = curproc->Group;
+
+	if (__sync_sub_and_fetch(&group->SyscallsActive, 1) == 0 && group->MappedSize > group->MemorySize)
+	{
+		lockGroupMemory(group);
+		releaseShrunkMemory(curproc, 0);
+		unlockGroupMemory(group);
 	}
-	curproc->MemorySize = memorySize;
-	switchToUserVirtualMemory(curproc);
-	return 0;
 }
 
 // Create a new process copying p as the parent.
@@ -226,15 +471,30 @@ int fork(void)
 	}
 
 	// Copy process state from Process.
-	if ((np->PageTable = copyProcessPageTable(curproc->PageTable, curproc->MemorySize)) == 0) 
+	spinlockAcquire(&processTable.Lock);
+	np->Group = allocateThreadGroup();
+	spinlockRelease(&processTable.Lock);
+	lockGroupMemory(curproc->Group);
+	if (np->Group == 0 || (np->PageTable = copyProcessPageTable(curproc->PageTable, curproc->Group->MemorySize)) == 0) 
 	{
+		unlockGroupMemory(curproc->Group);
 		freePhysicalMemoryPage(np->KernelStack);
 		np->KernelStack = 0;
-		np->State = UNUSED;
+		spinlockAcquire(&processTable.Lock);
+		if (np->Group != 0)
+		{
+			np->Group->NextFree = processTable.FreeGroups;
+			processTable.FreeGroups = np->Group;
+			np->Group = 0;
+		}
+		releaseProcessSlot(np);
+		spinlockRelease(&processTable.Lock);
 		return -1;
 	}
-	np->MemorySize = curproc->MemorySize;
-	np->Parent = curproc;
+	np->Group->MemorySize = curproc->Group->MemorySize;
+	np->Group->MappedSize = np->Group->MemorySize;
+	np->Group->Leader = np;
+	unlockGroupMemory(curproc->Group);
 	*np->Trapframe = *curproc->Trapframe;
 
 	// Clear %eax so that fork returns 0 in the child.
@@ -242,42 +502,163 @@ int fork(void)
 
 	for (i = 0; i < NOFILE; i++)
 	{
-		if (curproc->OpenFile[i])
-		{
-			np->OpenFile[i] = fileDup(curproc->OpenFile[i]);
-		}
+		// Another thread may be closing the descriptor
+		np->Group->OpenFile[i] = fileGet(&curproc->Group->OpenFile[i]);
 	}
 	safestrcpy(np->Cwd, curproc->Cwd, MAXCWDSIZE);
 	safestrcpy(np->Name, curproc->Name, sizeof(curproc->Name));
 	pid = np->ProcessId;
 	spinlockAcquire(&processTable.Lock);
-	np->State = RUNNABLE;
+	np->Parent = curproc;
+	np->Sibling = curproc->Children;
+	curproc->Children = np;
+	makeRunnable(np);
 	spinlockRelease(&processTable.Lock);
 
 	return pid;
 }
 
-// Exit the current process.  Does not return.
+// Create a new thread in the current process.  It shares the process's
+// memory and open files, and starts by calling function(argument) on the
+// given stack (the address just above the top of it).  If function
+// returns, it returns to an invalid address, so it should call exit.
+// Returns the new thread's process ID, or -1.
+
+int clone(uint32_t function, uint32_t argument, uint32_t stack)
+{
+	Process *np;
+	Process *curproc = myProcess();
+	uint32_t frame[2] = { 0xFFFFFFFF, argument };		// Return address and argument
+
+	if (stack < sizeof(frame) || stack > curproc->Group->MemorySize ||
+		copyToUserVirtualMemory(curproc->PageTable, stack - sizeof(frame), frame, sizeof(frame)) < 0)
+	{
+		return -1;
+	}
+	if ((np = allocateProcess()) == 0) 
+	{
+		return -1;
+	}
+	np->PageTable = curproc->PageTable;
+	*np->Trapframe = *curproc->Trapframe;
+	np->Trapframe->eip = function;
+	np->Trapframe->esp = stack - sizeof(frame);
+	np->Trapframe->eax = 0;
+	safestrcpy(np->Cwd, curproc->Cwd, MAXCWDSIZE);
+	safestrcpy(np->Name, curproc->Name, sizeof(curproc->Name));
+
+	spinlockAcquire(&processTable.Lock);
+	if (curproc->IsKilled)
+	{
+		// The process is exiting, and the new thread would not be killed
+		freePhysicalMemoryPage(np->KernelStack);
+		np->KernelStack = 0;
+		releaseProcessSlot(np);
+		spinlockRelease(&processTable.Lock);
+		return -1;
+	}
+	np->Group = curproc->Group;
+	np->Group->Threads++;
+	np->Group->ReferenceCount++;
+	np->Parent = np->Group->Leader;
+	np->Sibling = np->Parent->Children;
+	np->Parent->Children = np;
+	makeRunnable(np);
+	spinlockRelease(&processTable.Lock);
+	return np->ProcessId;
+}
+
+// Wait for a thread in the same process to exit and return its process ID.
+// Any thread can wait for any other, not just the one that created it, but
+// not for the main thread, which is waited for by its parent.
+// Return -1 if there is no such thread.
+
+int join(int pid)
+{
+	Process *p;
+	Process **link;
+	Process *curproc = myProcess();
+
+	spinlockAcquire(&processTable.Lock);
+	for (;;) 
+	{
+		p = findProcess(pid);
+		if (p == 0 || p == curproc || p->Group != curproc->Group || p == p->Group->Leader || curproc->IsKilled)
+		{
+			spinlockRelease(&processTable.Lock);
+			return -1;
+		}
+		if (p->State == ZOMBIE)
+		{
+			for (link = &p->Parent->Children; *link != p; link = &(*link)->Sibling)
+			{
+			}
+			*link = p->Sibling;
+			reapProcess(p);
+			spinlockRelease(&processTable.Lock);
+			return pid;
+		}
+		// Exiting threads wake up the other threads in their group
+		sleep(curproc->Group, &processTable.Lock);
+	}
+}
+
+// Mark every thread in a process as killed, waking those that are asleep, so
+// that each exits when it next returns to user mode.  Must hold
+// processTable.Lock.
+
+static void killGroup(ThreadGroup *group)
+{
+	Process *p;
+
+	for (p = processTable.All; p != 0; p = p->Next) 
+	{
+		if (p->Group != group || p->State == UNUSED || p->State == ZOMBIE)
+		{
+			continue;
+		}
+		p->IsKilled = 1;
+		// Wake process from sleep if necessary.
+		if (p->State == SLEEPING)
+		{
+			makeRunnable(p);
+		}
+	}
+}
+
+// Exit the current thread.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
+// When the main thread exits, or a thread that was killed, the whole
+// process is killed, and its parent does not see it exit until all of its
+// threads have.
 
 void exit(void)
 {
 	Process *curproc = myProcess();
 	Process *p;
+	Process **link;
 	int fd;
+	int lastThread;
 
 	if (curproc == initproc)
 	{
 		panic("init exiting");
 	}
-	// Close all open files.
-	for (fd = 0; fd < NOFILE; fd++) 
+	spinlockAcquire(&processTable.Lock);
+	if (curproc == curproc->Group->Leader || curproc->IsKilled)
 	{
-		if (curproc->OpenFile[fd]) 
+		killGroup(curproc->Group);
+	}
+	// Close all open files, if no other thread is using them.
+	lastThread = --curproc->Group->Threads == 0;
+	spinlockRelease(&processTable.Lock);
+	for (fd = 0; fd < NOFILE && lastThread; fd++) 
+	{
+		if (curproc->Group->OpenFile[fd]) 
 		{
-			fileClose(curproc->OpenFile[fd]);
-			curproc->OpenFile[fd] = 0;
+			fileClose(curproc->Group->OpenFile[fd]);
+			curproc->Group->OpenFile[fd] = 0;
 		}
 	}
 
@@ -285,19 +666,29 @@ void exit(void)
 
 	spinlockAcquire(&processTable.Lock);
 
-	// Parent might be sleeping in wait().
+	// Parent might be sleeping in wait(), or another thread in join().  The
+	// main thread's parent may be waiting for the last thread to exit.
 	wakeup1(curproc->Parent);
+	wakeup1(curproc->Group->Leader->Parent);
+	wakeup1(curproc->Group);
 
-	// Pass abandoned children to init.
-	for (p = processTable.Process; p < &processTable.Process[NPROC]; p++) 
+	// Pass abandoned children to init.  Threads stay with the main thread,
+	// which is not reaped until they have exited.
+	link = &curproc->Children;
+	while ((p = *link) != 0) 
 	{
-		if (p->Parent == curproc) 
+		if (p->Group == curproc->Group)
 		{
-			p->Parent = initproc;
-			if (p->State == ZOMBIE)
-			{
-				wakeup1(initproc);
-			}
+			link = &p->Sibling;
+			continue;
+		}
+		*link = p->Sibling;
+		p->Parent = initproc;
+		p->Sibling = initproc->Children;
+		initproc->Children = p;
+		if (p->State == ZOMBIE)
+		{
+			wakeup1(initproc);
 		}
 	}
 
@@ -307,39 +698,66 @@ void exit(void)
 	panic("zombie exit");
 }
 
+// Free the threads of an exited main thread, if they have all exited too.
+// Returns 1 if they have, 0 if some are still running.  Must hold
+// processTable.Lock.
+
+static int reapThreads(Process *leader)
+{
+	Process *p;
+	Process **link;
+
+	for (p = leader->Children; p != 0; p = p->Sibling) 
+	{
+		if (p->Group == leader->Group && p->State != ZOMBIE)
+		{
+			return 0;
+		}
+	}
+	link = &leader->Children;
+	while ((p = *link) != 0) 
+	{
+		if (p->Group == leader->Group)
+		{
+			*link = p->Sibling;
+			reapProcess(p);
+		}
+		else
+		{
+			link = &p->Sibling;
+		}
+	}
+	return 1;
+}
+
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
 
 int wait(void)
 {
 	Process *p;
+	Process **link;
 	int havekids, pid;
 	Process *curproc = myProcess();
 
 	spinlockAcquire(&processTable.Lock);
 	for (;;) 
 	{
-		// Scan through table looking for exited children.
+		// Look through the children for exited ones.  Threads in this
+		// process are waited for with join instead.
 		havekids = 0;
-		for (p = processTable.Process; p < &processTable.Process[NPROC]; p++) 
+		for (link = &curproc->Children; (p = *link) != 0; link = &p->Sibling) 
 		{
-			if (p->Parent != curproc)
+			if (p->Group == curproc->Group)
 			{
 				continue;
 			}
 			havekids = 1;
-			if (p->State == ZOMBIE) 
+			if (p->State == ZOMBIE && reapThreads(p)) 
 			{
 				// Found one.
-				pid = p->ProcessId;
-				freePhysicalMemoryPage(p->KernelStack);
-				p->KernelStack = 0;
-				freeMemoryAndPageTable(p->PageTable);
-				p->ProcessId = 0;
-				p->Parent = 0;
-				p->Name[0] = 0;
-				p->IsKilled = 0;
-				p->State = UNUSED;
+				*link = p->Sibling;
+				pid = reapProcess(p);
 				spinlockRelease(&processTable.Lock);
 				return pid;
 			}
@@ -369,6 +787,7 @@ void scheduler(void)
 {
 	Process *p;
 	Cpu *c = myCpu();
+	int ran;
 	c->Process = 0;
 	for (;;) 
 	{
@@ -377,8 +796,9 @@ void scheduler(void)
 
 		// Loop over process table looking for process to run.
 		spinlockAcquire(&processTable.Lock);
+		ran = 0;
 
-		for (p = processTable.Process; p < &processTable.Process[NPROC]; p++) 
+		for (p = processTable.All; p != 0; p = p->Next) 
 		{
 			if (p->State != RUNNABLE)
 			{
@@ -390,15 +810,37 @@ void scheduler(void)
 			c->Process = p;
 			switchToUserVirtualMemory(p);
 			p->State = RUNNING;
+			perfCountOn(c - cpus, PERF_CONTEXT_SWITCHES, 1);
 
 			swtch(&(c->Scheduler), p->Context);
-			switchToKernelVirtualMemory();
 
 			// Process is done running for now.
 			// It should have changed its p->state before coming back.
+			// Its address space stays loaded, since the scheduler only
+			// uses the kernel mappings and the next process may share it.
 			c->Process = 0;
+			ran = 1;
+		}
+		// A page table is only freed with processTable.Lock held, or by exec
+		// once the process has stopped using it, so a CPU must not keep one
+		// loaded that is not its running process's once it lets go of the lock.
+		switchToKernelVirtualMemory();
+		if (ran)
+		{
+			spinlockRelease(&processTable.Lock);
+			continue;
 		}
+		// Nothing to run.  Keep interrupts off until timerIdle halts, so that an
+		// interrupt that makes a process runnable cannot come before the halt,
+		// and mark this CPU idle before letting go of the lock, so that another
+		// CPU that makes a process runnable sends it a wakeup interrupt.
+		c->Idle = 1;
+		perfCountOn(c - cpus, PERF_IDLE_HALTS, 1);
+		pushCli();
 		spinlockRelease(&processTable.Lock);
+		timerIdle();
+		c->Idle = 0;
+		popCli();
 	}
 }
 
@@ -458,7 +900,17 @@ void forkret(void)
 		// Some initialization functions must be run in the context
 		// of a regular process (e.g., they call sleep), and thus cannot
 		// be run from main().
-		fsFat12Initialise();
+		if (vfsMount("/", &fsFatOperations, 0) < 0)
+		{
+			panic("Cannot mount root file system");
+		}
+		if (vfsMount("/tmp", &tmpfsOperations, 0) < 0)
+		{
+			cprintf("Cannot mount /tmp\n");
+		}
+		// Serve the user programs from the initial ramdisk if the boot
+		// loader loaded one.  If not, they are read from the disk.
+		vfsMount("/usrbin", &initrdOperations, 0);
 		first = 0;
 	}
 
@@ -514,11 +966,11 @@ static void wakeup1(void *chan)
 {
 	Process *p;
 
-	for (p = processTable.Process; p < &processTable.Process[NPROC]; p++)
+	for (p = processTable.All; p != 0; p = p->Next)
 	{
 		if (p->State == SLEEPING && p->Chan == chan)
 		{
-			p->State = RUNNABLE;
+			makeRunnable(p);
 		}
 	}
 }
@@ -531,6 +983,27 @@ void wakeup(void *chan)
 	spinlockRelease(&processTable.Lock);
 }
 
+// Wake up at most count processes sleeping on chan, and return how many
+// were woken.
+
+int wakeupCount(void *chan, int count)
+{
+	Process *p;
+	int woken = 0;
+
+	spinlockAcquire(&processTable.Lock);
+	for (p = processTable.All; p != 0 && woken < count; p = p->Next)
+	{
+		if (p->State == SLEEPING && p->Chan == chan)
+		{
+			makeRunnable(p);
+			woken++;
+		}
+	}
+	spinlockRelease(&processTable.Lock);
+	return woken;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -540,22 +1013,15 @@ int kill(int pid)
 	Process *p;
 
 	spinlockAcquire(&processTable.Lock);
-	for (p = processTable.Process; p < &processTable.Process[NPROC]; p++) 
+	p = findProcess(pid);
+	if (p == 0)
 	{
-		if (p->ProcessId == pid) 
-		{
-			p->IsKilled = 1;
-			// Wake process from sleep if necessary.
-			if (p->State == SLEEPING)
-			{
-				p->State = RUNNABLE;
-			}
-			spinlockRelease(&processTable.Lock);
-			return 0;
-		}
+		spinlockRelease(&processTable.Lock);
+		return -1;
 	}
+	killGroup(p->Group);
 	spinlockRelease(&processTable.Lock);
-	return -1;
+	return 0;
 }
 
 // Print a process listing to console.  For debugging.
@@ -579,7 +1045,7 @@ void processDump(void)
 	uint32_t pc[10];
 
 	cprintf("\n");
-	for (p = processTable.Process; p < &processTable.Process[NPROC]; p++) 
+	for (p = processTable.All; p != 0; p = p->Next) 
 	{
 		if (p->State == UNUSED)
 		{
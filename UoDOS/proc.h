@@ -9,6 +9,9 @@ struct _Cpu
   int					CliDepth;           // Depth of pushCli nesting.
   int					InterruptsEnabled;  // Were interrupts enabled before pushCli?
   Process *				Process;			// The process running on this cpu or null
+  volatile int			Idle;				// Halted in the scheduler with nothing to run
+  pde_t *				PageTable;			// Page directory loaded in CR3
+  volatile int			TlbFlushPending;	// Asked by tlbShootdown to flush its TLB
 };
 
 extern Cpu cpus[NCPU];
@@ -36,20 +39,43 @@ struct _Context
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// The state shared by the threads of a process.  fork gives the new process
+// its own; clone gives the new thread its creator's.  The threads that clone
+// creates are children of the leader, the thread that fork created.  The
+// counts and
+// Growing are protected by processTable.Lock, apart from SyscallsActive,
+// which is changed atomically.
+struct _ThreadGroup
+{
+	int					Threads;			// Number of threads that have not exited
+	int					ReferenceCount;		// Number of threads that have not been reaped
+	Process *			Leader;				// The process's main thread
+	uint32_t			MemorySize;         // Size of process memory (bytes)
+	uint32_t			MappedSize;			// Top of the mapped memory, above MemorySize after a shrink (see growProcess)
+	int					Growing;			// A thread is changing or copying the memory (see lockGroupMemory)
+	volatile int		SyscallsActive;		// Number of threads in a system call
+	File *				OpenFile[NOFILE];	// Open files
+	ThreadGroup *		NextFree;			// Next in the list of unused thread groups
+};
+
 // Per-process state
 struct _Process 
 {
-	uint32_t			MemorySize;         // Size of process memory (bytes)
-	pde_t*				PageTable;          // Page table
+	ThreadGroup *		Group;				// Memory size and open files, shared with other threads
+	pde_t*				PageTable;          // Page table (the same for all the threads in a group)
 	char *				KernelStack;        // Bottom of kernel stack for this process
 	enum procstate		State;				// Process state
 	int					ProcessId;          // Process ID
 	Process *			Parent;				// Parent process
+	Process *			Children;			// First of this process's children
+	Process *			Sibling;			// Next child of the same parent
+	Process *			HashNext;			// Next process in the same process ID hash chain
+	Process *			Next;				// Next in the list of all process structures
+	Process *			NextFree;			// Next in the list of unused process structures
 	struct Trapframe *	Trapframe;			// Trap frame for current syscall
 	Context *			Context;			// swtch() here to run process
 	void *				Chan;               // If non-zero, sleeping on chan
 	int					IsKilled;           // If non-zero, have been killed
-	File *				OpenFile[NOFILE];	// Open files
 	char				Cwd[MAXCWDSIZE];	// Current directory
 	char				Name[16];		    // Process name (debugging)
 };
@@ -0,0 +1,24 @@
+// rm: Remove files or empty directories.  Usage: rm file...
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+int main(int argc, char *argv[])
+{
+	int i;
+
+	if (argc < 2)
+	{
+		printf("usage: rm file...\n");
+		exit();
+	}
+	for (i = 1; i < argc; i++)
+	{
+		if (unlink(argv[i]) < 0)
+		{
+			printf("rm: cannot remove %s\n", argv[i]);
+		}
+	}
+	exit();
+}
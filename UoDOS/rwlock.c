@@ -0,0 +1,79 @@
+// Reader-writer spin locks.
+//
+// For tables that are read far more often than they are changed.  Readers
+// only wait while a writer holds the lock or is waiting for it, so readers
+// on different CPUs do not wait for each other.  A writer first sets the
+// writer bit, which stops any more readers getting in, and then waits for
+// the readers already in to leave.  So a steady stream of readers cannot
+// starve a writer.  As with spinlocks, interrupts are off while the lock is
+// held.  A CPU must not take the read lock again while it holds it, since
+// a writer may have started waiting in between.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "rwlock.h"
+
+void readWriteLockInitialise(ReadWriteLock * lock, char * name)
+{
+	lock->State = 0;
+	lock->Name = name;
+}
+
+void readLockAcquire(ReadWriteLock * lock)
+{
+	pushCli();
+	for (;;)
+	{
+		uint32_t state = lock->State;
+		// The compare and exchange is atomic, and is a memory barrier
+		if ((state & RWLOCK_WRITER) == 0 && __sync_bool_compare_and_swap(&lock->State, state, state + 1))
+		{
+			break;
+		}
+		cpuRelax();
+	}
+}
+
+void readLockRelease(ReadWriteLock * lock)
+{
+	if ((lock->State & ~RWLOCK_WRITER) == 0)
+	{
+		panic("readLockRelease");
+	}
+	__sync_fetch_and_sub(&lock->State, 1);
+	popCli();
+}
+
+void writeLockAcquire(ReadWriteLock * lock)
+{
+	pushCli();
+	for (;;)
+	{
+		uint32_t state = lock->State;
+		if ((state & RWLOCK_WRITER) == 0 && __sync_bool_compare_and_swap(&lock->State, state, state | RWLOCK_WRITER))
+		{
+			break;
+		}
+		cpuRelax();
+	}
+	// Wait for the readers to leave
+	while (lock->State != RWLOCK_WRITER)
+	{
+		cpuRelax();
+	}
+	__sync_synchronize();
+}
+
+void writeLockRelease(ReadWriteLock * lock)
+{
+	if (lock->State != RWLOCK_WRITER)
+	{
+		panic("writeLockRelease");
+	}
+	// No reader can have got in while the writer bit was set, so a plain store will do
+	__sync_synchronize();
+	lock->State = 0;
+	popCli();
+}
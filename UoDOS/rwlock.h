@@ -0,0 +1,10 @@
+// Reader-writer spin lock.  Any number of CPUs can hold it for reading at
+// once, or one CPU for writing.
+struct _ReadWriteLock
+{
+	volatile uint32_t	State;			// RWLOCK_WRITER bit + number of readers
+	char *				Name;			// Name of lock.
+};
+
+#define RWLOCK_WRITER	0x80000000		// Held by, or being waited for by, a writer
+
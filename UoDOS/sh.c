@@ -426,7 +426,7 @@ struct cmd*	parseredirs(struct cmd *cmd, char **ps, char *es)
 				cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
 				break;
 			case '>':
-				cmd = redircmd(cmd, q, eq, O_WRONLY | O_CREATE, 1);
+				cmd = redircmd(cmd, q, eq, O_WRONLY | O_CREATE | O_TRUNC, 1);
 				break;
 			case '+':  // >>
 				cmd = redircmd(cmd, q, eq, O_WRONLY | O_CREATE, 1);
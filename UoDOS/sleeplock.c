@@ -16,23 +16,43 @@ void sleeplockInitialise(Sleeplock *lk, char *name)
 	lk->Name = name;
 	lk->Locked = 0;
 	lk->Pid = 0;
+#ifdef LOCK_PROFILE
+	lk->Profile = lockProfileRegister(name, 1);
+#endif
 }
 
 void sleeplockAcquire(Sleeplock *lk)
 {
+#ifdef LOCK_PROFILE
+	uint64_t waitStart = 0;
+#endif
+
 	spinlockAcquire(&lk->Spinlock);
+#ifdef LOCK_PROFILE
+	if (lk->Locked)
+	{
+		waitStart = readTimeStampCounter();
+	}
+#endif
 	while (lk->Locked) 
 	{
 		sleep(lk, &lk->Spinlock);
 	}
 	lk->Locked = 1;
 	lk->Pid = myProcess()->ProcessId;
+#ifdef LOCK_PROFILE
+	lk->AcquiredAt = readTimeStampCounter();
+	lockProfileAcquire(lk->Profile, waitStart ? lk->AcquiredAt - waitStart : 0);
+#endif
 	spinlockRelease(&lk->Spinlock);
 }
 
 void sleeplockRelease(Sleeplock *lk)
 {
 	spinlockAcquire(&lk->Spinlock);
+#ifdef LOCK_PROFILE
+	lockProfileRelease(lk->Profile, readTimeStampCounter() - lk->AcquiredAt);
+#endif
 	lk->Locked = 0;
 	lk->Pid = 0;
 	wakeup(lk);
@@ -7,5 +7,9 @@ struct _Sleeplock
   // For debugging:
   char *	Name;		// Name of lock.
   int		Pid;		// Process holding lock
+#ifdef LOCK_PROFILE
+  int		Profile;	// Slot in the lock profiler's table (see lockprof.c)
+  uint64_t	AcquiredAt;	// Time stamp counter when the lock was acquired
+#endif
 };
 
@@ -1,4 +1,11 @@
 // Mutual exclusion spin locks.
+//
+// These are ticket locks.  A CPU that wants the lock takes the next ticket
+// and waits until the lock's owner number reaches it.  Releasing the lock
+// moves the owner number on by one.  So waiting CPUs get the lock in the
+// order they asked for it, and none of them can be starved.  While it waits,
+// a CPU only reads the lock, so its cache line is shared by all the waiting
+// CPUs and only moves when the lock is handed over.
 
 #include "types.h"
 #include "defs.h"
@@ -8,12 +15,17 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "perf.h"
 
 void spinlockInitialise(Spinlock *lk, char *name)
 {
 	lk->Name = name;
-	lk->Locked = 0;
+	lk->Owner = 0;
+	lk->Next = 0;
 	lk->Cpu = 0;
+#ifdef LOCK_PROFILE
+	lk->Profile = lockProfileRegister(name, 0);
+#endif
 }
 
 // Acquire the lock.
@@ -23,14 +35,30 @@ void spinlockInitialise(Spinlock *lk, char *name)
 
 void spinlockAcquire(Spinlock *lk)
 {
+	uint32_t spins = 0;
+	uint16_t ticket;
+#ifdef LOCK_PROFILE
+	uint64_t waitStart = 0;
+#endif
+
 	pushCli(); // disable interrupts to avoid deadlock.
 	if (isHolding(lk))
 	{
 		panic("spinlockAcquire");
 	}
-	// The xchg is atomic.
-	while (atomicExchange(&lk->Locked, 1) != 0)
-		;
+	// The xadd is atomic, so every CPU gets a different ticket.
+	ticket = atomicFetchAndAddWord(&lk->Next, 1);
+	while (lk->Owner != ticket)
+	{
+#ifdef LOCK_PROFILE
+		if (spins == 0)
+		{
+			waitStart = readTimeStampCounter();
+		}
+#endif
+		spins++;
+		cpuRelax();
+	}
 
 	// Tell the C compiler and the processor to not move loads or stores
 	// past this point, to ensure that the critical section's memory
@@ -39,7 +67,18 @@ void spinlockAcquire(Spinlock *lk)
 
 	// Record info about lock acquisition for debugging.
 	lk->Cpu = myCpu();
+#ifdef LOCK_DEBUG
 	getProcessCallStack(&lk, lk->Pcs);
+#endif
+	perfCountOn(lk->Cpu - cpus, PERF_LOCK_ACQUIRES, 1);
+	if (spins)
+	{
+		perfCountOn(lk->Cpu - cpus, PERF_LOCK_SPINS, spins);
+	}
+#ifdef LOCK_PROFILE
+	lk->AcquiredAt = readTimeStampCounter();
+	lockProfileAcquire(lk->Profile, spins ? lk->AcquiredAt - waitStart : 0);
+#endif
 }
 
 // Release the lock.
@@ -49,7 +88,12 @@ void spinlockRelease(Spinlock *lk)
 	{
 		panic("spinlockRelease");
 	}
+#ifdef LOCK_DEBUG
 	lk->Pcs[0] = 0;
+#endif
+#ifdef LOCK_PROFILE
+	lockProfileRelease(lk->Profile, readTimeStampCounter() - lk->AcquiredAt);
+#endif
 	lk->Cpu = 0;
 
 	// Tell the C compiler and the processor to not move loads or stores
@@ -59,10 +103,9 @@ void spinlockRelease(Spinlock *lk)
 	// stores; __sync_synchronize() tells them both not to.
 	__sync_synchronize();
 
-	// spinlockRelease the lock, equivalent to lk->Locked = 0.
-	// This code can't use a C assignment, since it might
-	// not be atomic. A real OS would use C atomics here.
-	asm volatile("movl $0, %0" : "+m" (lk->Locked) : );
+	// Hand the lock to the next ticket.  Only the CPU holding the lock
+	// writes Owner, so this does not need a locked instruction.
+	lk->Owner = lk->Owner + 1;
 
 	popCli();
 }
@@ -92,7 +135,7 @@ void getProcessCallStack(void *v, uint32_t pcs[])
 // Check whether this cpu is holding the lock.
 int isHolding(Spinlock *lock)
 {
-	return lock->Locked && lock->Cpu == myCpu();
+	return lock->Owner != lock->Next && lock->Cpu == myCpu();
 }
 
 
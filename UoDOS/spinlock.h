@@ -1,12 +1,19 @@
 // Mutual exclusion lock.
 struct _Spinlock
 {
-	uint32_t			Locked;			// Is the lock held?
+	volatile uint16_t	Owner;			// Ticket that may hold the lock.  It is held when Owner != Next
+	volatile uint16_t	Next;			// Next ticket to hand out
 
 	// For debugging:
 	char *				Name;			// Name of lock.
 	Cpu *		Cpu;			// The cpu holding the lock.
+#ifdef LOCK_DEBUG
 	uint32_t			Pcs[10];		// The call stack (an array of program counters)
 										// that locked the lock.
+#endif
+#ifdef LOCK_PROFILE
+	int					Profile;		// Slot in the lock profiler's table (see lockprof.c)
+	uint64_t			AcquiredAt;		// Time stamp counter when the lock was acquired
+#endif
 };
 
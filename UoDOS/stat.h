@@ -2,11 +2,17 @@
 #define T_FILE 2   // File
 #define T_DEV  3   // Device
 
+// Times are in the packed DOS format used by FAT directory entries:
+// date in the high 16 bits, time in the low 16 bits.
+
 struct _Stat 
 {
   short		type;	// Type of file
   int		dev;    // File system's disk device
-  uint32_t	ino;    // Inode number
+  uint32_t	ino;    // Inode number (first cluster of the file)
   short		nlink;	// Number of links to file
   uint32_t	size;   // Size of file in bytes
+  uint32_t	ctime;	// Time of creation
+  uint32_t	mtime;	// Time of last modification
+  uint32_t	atime;	// Date of last access (time part is always 0)
 };
@@ -0,0 +1,112 @@
+// stats: Show the kernel's performance counters (see perf.h).
+//
+// Once a second, prints how much each counter went up during that second,
+// followed by the system calls made, by name.  Usage: stats [seconds]
+// (with no argument, it runs until it is killed).
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "perf.h"
+#include "syscall.h"
+
+#define TICKSPERSECOND	100		// Units of the sleep system call
+#define HEADEREVERY		20		// Repeat the column headings after this many lines
+
+static char * counterNames[NPERFCOUNTERS] =
+{
+	[PERF_BUFFER_HITS] = "bufhit",
+	[PERF_BUFFER_MISSES] = "bufmiss",
+	[PERF_IDE_READS] = "ideread",
+	[PERF_IDE_WRITES] = "idewrite",
+	[PERF_CONTEXT_SWITCHES] = "switches",
+	[PERF_SYSCALLS] = "syscalls",
+	[PERF_PAGE_ALLOCATIONS] = "pgalloc",
+	[PERF_PAGE_FREES] = "pgfree",
+	[PERF_LOCK_ACQUIRES] = "locks",
+	[PERF_LOCK_SPINS] = "spins",
+	[PERF_IDLE_HALTS] = "halts",
+};
+
+static char * syscallNames[] = SYSCALL_NAMES;
+
+static struct _PerfCounters previous;
+static struct _PerfCounters current;
+
+// Print a number right aligned in a column of the given width
+
+static void printColumn(uint32_t value, int width)
+{
+	int digits = 1;
+
+	for (uint32_t v = value; v >= 10; v /= 10)
+	{
+		digits++;
+	}
+	while (digits++ < width)
+	{
+		printf(" ");
+	}
+	printf("%d", value);
+}
+
+static void printHeadings(void)
+{
+	for (int i = 0; i < NPERFCOUNTERS; i++)
+	{
+		int length = strlen(counterNames[i]);
+		while (length++ < 9)
+		{
+			printf(" ");
+		}
+		printf("%s", counterNames[i]);
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int seconds = argc > 1 ? atoi(argv[1]) : -1;
+
+	if (getcounters(&previous) < 0)
+	{
+		printf("stats: cannot read the counters\n");
+		exit();
+	}
+	for (int line = 0; seconds < 0 || line < seconds; line++)
+	{
+		sleep(TICKSPERSECOND);
+		getcounters(&current);
+		if (line % HEADEREVERY == 0)
+		{
+			printHeadings();
+		}
+		for (int i = 0; i < NPERFCOUNTERS; i++)
+		{
+			printColumn(current.Counters[i] - previous.Counters[i], 9);
+		}
+		printf("\n");
+
+		// The system calls made, leaving out the sleep and getcounters calls of this program
+		int any = 0;
+		for (int i = 1; i < PERF_MAXSYSCALLS && i < sizeof(syscallNames) / sizeof(syscallNames[0]); i++)
+		{
+			uint32_t count = current.Syscalls[i] - previous.Syscalls[i];
+			if (i == SYS_sleep || i == SYS_getcounters)
+			{
+				count--;
+			}
+			if (count > 0)
+			{
+				printf("%s %s %d", any ? "," : "         syscalls:", syscallNames[i], count);
+				any = 1;
+			}
+		}
+		if (any)
+		{
+			printf("\n");
+		}
+		previous = current;
+	}
+	exit();
+}
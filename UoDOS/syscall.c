@@ -7,6 +7,7 @@
 #include "x86.h"
 #include "syscall.h"
 #include "syscalltable.h"
+#include "perf.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %eax.
@@ -20,7 +21,7 @@ int fetchint(uint32_t addr, int *ip)
 {
 	Process *curproc = myProcess();
 
-	if (addr >= curproc->MemorySize || addr + 4 > curproc->MemorySize)
+	if (addr >= curproc->Group->MemorySize || addr + 4 > curproc->Group->MemorySize)
 	{
 		return -1;
 	}
@@ -37,12 +38,12 @@ int fetchstr(uint32_t addr, char **pp)
 	char *s, *ep;
 	Process *curproc = myProcess();
 
-	if (addr >= curproc->MemorySize)
+	if (addr >= curproc->Group->MemorySize)
 	{
 		return -1;
 	}
 	*pp = (char*)addr;
-	ep = (char*)curproc->MemorySize;
+	ep = (char*)curproc->Group->MemorySize;
 	for (s = *pp; s < ep; s++) 
 	{
 		if (*s == 0)
@@ -73,7 +74,7 @@ int argptr(int n, char **pp, int size)
 	{
 		return -1;
 	}
-	if (size < 0 || (uint32_t)i >= curproc->MemorySize || (uint32_t)i + size > curproc->MemorySize)
+	if (size < 0 || (uint32_t)i >= curproc->Group->MemorySize || (uint32_t)i + size > curproc->Group->MemorySize)
 	{
 		return -1;
 	}
@@ -83,8 +84,10 @@ int argptr(int n, char **pp, int size)
 
 // Fetch the nth parameter to the system call as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (Threads share memory, so another thread could change the string
+// after this check.  The kernel's uses of it stay within the process's
+// memory, which stays mapped until the system call ends even if another
+// thread shrinks the process; see growProcess.)
 
 int argstr(int n, char **pp)
 {
@@ -104,9 +107,12 @@ void syscall(void)
 	Process *curproc = myProcess();
 
 	num = curproc->Trapframe->eax;
+	perfCountSyscall(num);
 	if (num > 0 && num < NELEM(syscalls) && syscalls[num]) 
 	{
+		beginSystemCall();
 		curproc->Trapframe->eax = syscalls[num]();
+		endSystemCall();
 	}
 	else 
 	{
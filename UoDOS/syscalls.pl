@@ -32,7 +32,17 @@ my @syscalls = (
 				"write", 
 				"close",
 				"chdir",
-				"getcwd"
+				"getcwd",
+				"getdents",
+				"mkdir",
+				"unlink",
+				"ftruncate",
+				"getcounters",
+				"clone",
+				"join",
+				"futex",
+				"nanosleep",
+				"clock_gettime"
 			   );
 
 my $i;			   
@@ -74,6 +84,17 @@ for ($i = 0; $i < scalar(@syscalls); $i++)
 		print "\%assign SYS_$syscalls[$i]\t\t$index\n";	
 	}
 }
+if ($ARGV[0] eq '-h')
+{
+	print "\n";
+	print "// Names of the system calls, indexed by number\n";
+	print "#define SYSCALL_NAMES { \"\"";
+	for ($i = 0; $i < scalar(@syscalls); $i++)
+	{
+		print ", \"$syscalls[$i]\"";
+	}
+	print " }\n";
+}
 if ($ARGV[0] eq '-a')
 {
 	print "%include \"syscall.asm\"\n";
@@ -8,17 +8,23 @@
 #include "stat.h"
 #include "mmu.h"
 #include "proc.h"
-#include "fs.h"
 #include "spinlock.h"
+#include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "dirent.h"
+#include "vfs.h"
 
 // Retrieve an argument to the system call that is an FD
 //
 // n   = The parameter number (0 = The first parameter, 1 = second parameter, etc).
 // pfd = Returns the fd number (set to 0 if not required)
-// pf  = Returns the pointer to the File structure (set to 0 if not required).
+// pf  = Returns the pointer to the File structure.
+//
+// Another thread may close the descriptor at any time, so this takes a
+// reference to the file, which the caller must drop with fileClose.  Check
+// the other arguments first, so that there is nothing to undo if they fail.
 
 static int argfd(int n, int *pfd, File **pf)
 {
@@ -29,7 +35,7 @@ static int argfd(int n, int *pfd, File **pf)
 	{
 		return -1;
 	}
-	if (fd < 0 || fd >= NOFILE || (f = myProcess()->OpenFile[fd]) == 0)
+	if (fd < 0 || fd >= NOFILE || (f = fileGet(&myProcess()->Group->OpenFile[fd])) == 0)
 	{
 		return -1;
 	}
@@ -37,10 +43,7 @@ static int argfd(int n, int *pfd, File **pf)
 	{
 		*pfd = fd;
 	}
-	if (pf)
-	{
-		*pf = f;
-	}
+	*pf = f;
 	return 0;
 }
 
@@ -52,11 +55,12 @@ static int fdalloc(File *f)
 	int fd;
 	Process *curproc = myProcess();
 
+	// Other threads in the process may be allocating descriptors too, so
+	// claim the slot with an atomic compare and exchange
 	for (fd = 0; fd < NOFILE; fd++) 
 	{
-		if (curproc->OpenFile[fd] == 0) 
+		if (curproc->Group->OpenFile[fd] == 0 && __sync_bool_compare_and_swap(&curproc->Group->OpenFile[fd], 0, f)) 
 		{
-			curproc->OpenFile[fd] = f;
 			return fd;
 		}
 	}
@@ -74,11 +78,12 @@ int sys_dup(void)
 	{
 		return -1;
 	}
+	// The new descriptor keeps the reference that argfd took
 	if ((fd = fdalloc(f)) < 0)
 	{
+		fileClose(f);
 		return -1;
 	}
-	fileDup(f);
 	return fd;
 }
 
@@ -90,11 +95,13 @@ int sys_read(void)
 	int n;
 	char *p;
 
-	if (argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+	if (argint(2, &n) < 0 || argptr(1, &p, n) < 0 || argfd(0, 0, &f) < 0)
 	{
 		return -1;
 	}
-	return fileRead(f, p, n);
+	n = fileRead(f, p, n);
+	fileClose(f);
+	return n;
 }
 
 // Write to file.  Only implemented for pipes and console at present. 
@@ -104,11 +111,13 @@ int sys_write(void)
 	File *f;
 	int n;
 	char *p;
-	if (argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+	if (argint(2, &n) < 0 || argptr(1, &p, n) < 0 || argfd(0, 0, &f) < 0)
 	{
 		return -1;
 	}
-	return fileWrite(f, p, n);
+	n = fileWrite(f, p, n);
+	fileClose(f);
+	return n;
 }
 
 // Close file.
@@ -122,23 +131,56 @@ int sys_close(void)
 	{
 		return -1;
 	}
-	myProcess()->OpenFile[fd] = 0;
+	// Another thread may be closing the same descriptor, so only the one
+	// that clears the slot drops the slot's reference
+	if (!__sync_bool_compare_and_swap(&myProcess()->Group->OpenFile[fd], f, 0))
+	{
+		fileClose(f);
+		return -1;
+	}
+	fileClose(f);
 	fileClose(f);
 	return 0;
 }
 
-// Return file stats.  Not fully implemented.
+// Return file stats.
 
 int sys_fstat(void)
 {
 	File *f;
 	Stat *st;
+	int result;
 
-	if (argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+	if (argptr(1, (void*)&st, sizeof(*st)) < 0 || argfd(0, 0, &f) < 0)
 	{
 		return -1;
 	}
-	return fileStat(f, st);
+	result = fileStat(f, st);
+	fileClose(f);
+	return result;
+}
+
+// Read a batch of decoded directory entries from an open directory.
+// Returns the number of entries read, 0 at the end of the directory.
+
+int sys_getdents(void)
+{
+	File *f;
+	int count;
+	Dirent *dirents;
+
+	// Check count before multiplying, so that the size cannot wrap round
+	// to a small number that passes argptr
+	if (argint(2, &count) < 0 || count < 0 ||
+		count > 0x7FFFFFFF / sizeof(Dirent) ||
+		argptr(1, (void*)&dirents, count * sizeof(Dirent)) < 0 ||
+		argfd(0, 0, &f) < 0)
+	{
+		return -1;
+	}
+	count = fileReadDirectory(f, dirents, count);
+	fileClose(f);
+	return count;
 }
 
 // Open a file. 
@@ -155,23 +197,86 @@ int sys_open(void)
 	}
 	
 	Process *curproc = myProcess();
-	// At the moment, only file reading is supported
-	f = fsFat12Open(curproc->Cwd, path, 0);
+	if (omode & O_CREATE)
+	{
+		f = vfsCreate(curproc->Cwd, path);
+	}
+	else
+	{
+		f = vfsOpen(curproc->Cwd, path, 0);
+	}
 	if (f == 0)
 	{
 		return -1;
 	}
+	f->Readable = !(omode & O_WRONLY);
+	f->Writable = (omode & O_WRONLY) || (omode & O_RDWR);
+	if (f->Writable && f->Type == FD_DIR)
+	{
+		// Directories are only changed through mkdir and unlink
+		fileClose(f);
+		return -1;
+	}
+	if ((omode & O_TRUNC) && f->Writable && f->Type == FD_FILE && vfsTruncate(f, 0) < 0)
+	{
+		fileClose(f);
+		return -1;
+	}
 	fd = fdalloc(f);
 	if (fd < 0)
 	{
 		fileClose(f);
 		return -1;
 	}
-	f->Readable = !(omode & O_WRONLY);
-	f->Writable = (omode & O_WRONLY) || (omode & O_RDWR);
 	return fd;
 }
 
+// Create a directory
+
+int sys_mkdir(void)
+{
+	char *path;
+
+	if (argstr(0, &path) < 0)
+	{
+		return -1;
+	}
+	return vfsMakeDirectory(myProcess()->Cwd, path);
+}
+
+// Remove a file or an empty directory
+
+int sys_unlink(void)
+{
+	char *path;
+
+	if (argstr(0, &path) < 0)
+	{
+		return -1;
+	}
+	return vfsRemove(myProcess()->Cwd, path);
+}
+
+// Set the size of an open file
+
+int sys_ftruncate(void)
+{
+	File *f;
+	int size;
+	int result = -1;
+
+	if (argint(1, &size) < 0 || size < 0 || argfd(0, 0, &f) < 0)
+	{
+		return -1;
+	}
+	if (f->Type == FD_FILE && f->Writable)
+	{
+		result = vfsTruncate(f, size);
+	}
+	fileClose(f);
+	return result;
+}
+
 // Execute a program
 
 int sys_exec(void)
@@ -233,11 +338,11 @@ int sys_pipe(void)
 	fd0 = -1;
 	if ((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0) 
 	{
-		if (fd0 >= 0)
+		// Another thread may already have closed the read descriptor
+		if (fd0 < 0 || __sync_bool_compare_and_swap(&myProcess()->Group->OpenFile[fd0], rf, 0))
 		{
-			myProcess()->OpenFile[fd0] = 0;
+			fileClose(rf);
 		}
-		fileClose(rf);
 		fileClose(wf);
 		return -1;
 	}
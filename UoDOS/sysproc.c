@@ -6,6 +6,9 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "perf.h"
+#include "futex.h"
+#include "timer.h"
 
 int sys_fork(void)
 {
@@ -14,6 +17,8 @@ int sys_fork(void)
 
 int sys_exit(void)
 {
+	// exit does not return to syscall, so leave the system call here
+	endSystemCall();
 	exit();
 	return 0;  // not reached
 }
@@ -35,6 +40,53 @@ int sys_kill(void)
 	return kill(pid);
 }
 
+int sys_clone(void)
+{
+	int function;
+	int argument;
+	int stack;
+
+	if (argint(0, &function) < 0 || argint(1, &argument) < 0 || argint(2, &stack) < 0)
+	{
+		return -1;
+	}
+	return clone(function, argument, stack);
+}
+
+int sys_join(void)
+{
+	int pid;
+
+	if (argint(0, &pid) < 0)
+	{
+		return -1;
+	}
+	return join(pid);
+}
+
+int sys_futex(void)
+{
+	char *address;
+	int operation;
+	int value;
+
+	if (argptr(0, &address, sizeof(int)) < 0 || argint(1, &operation) < 0 || argint(2, &value) < 0)
+	{
+		return -1;
+	}
+	switch (operation)
+	{
+		case FUTEX_WAIT:
+			return futexWait((int *)address, value);
+
+		case FUTEX_WAKE:
+			return futexWake((int *)address, value);
+
+		default:
+			return -1;
+	}
+}
+
 int sys_getpid(void)
 {
 	return myProcess()->ProcessId;
@@ -49,8 +101,8 @@ int sys_sbrk(void)
 	{
 		return -1;
 	}
-	addr = myProcess()->MemorySize;
-	if (growProcess(n) < 0)
+	addr = growProcess(n);
+	if (addr < 0)
 	{
 		return -1;
 	}
@@ -60,35 +112,58 @@ int sys_sbrk(void)
 int sys_sleep(void)
 {
 	int n;
-	uint32_t ticks0;
 
-	if (argint(0, &n) < 0)
+	if (argint(0, &n) < 0 || n < 0)
 	{
 		return -1;
 	}
-	spinlockAcquire(&tickslock);
-	ticks0 = ticks;
-	while (ticks - ticks0 < n) 
+	return timerSleep((uint64_t)n * (1000000000 / TICKSPERSECOND));
+}
+
+// Sleep for the time in a Timespec
+
+int sys_nanosleep(void)
+{
+	Timespec *duration;
+
+	if (argptr(0, (char **)&duration, sizeof(*duration)) < 0 || duration->Nanoseconds >= 1000000000)
 	{
-		if (myProcess()->IsKilled) 
-		{
-			spinlockRelease(&tickslock);
-			return -1;
-		}
-		sleep(&ticks, &tickslock);
+		return -1;
+	}
+	return timerSleep((uint64_t)duration->Seconds * 1000000000 + duration->Nanoseconds);
+}
+
+// Read the clock given by the first argument into a Timespec
+
+int sys_clock_gettime(void)
+{
+	int clock;
+	Timespec *time;
+
+	if (argint(0, &clock) < 0 || argptr(1, (char **)&time, sizeof(*time)) < 0)
+	{
+		return -1;
 	}
-	spinlockRelease(&tickslock);
+	return clockGetTime(clock, time);
+}
+
+// Copy the performance counters (see perf.c) to the caller
+
+int sys_getcounters(void)
+{
+	PerfCounters *counters;
+
+	if (argptr(0, (void*)&counters, sizeof(PerfCounters)) < 0)
+	{
+		return -1;
+	}
+	perfRead(counters);
 	return 0;
 }
 
-// return how many clock tick interrupts have occurred
-// since start.
+// return how many clock ticks (TICKSPERSECOND a second)
+// have passed since start.
 int sys_uptime(void)
 {
-	uint32_t xticks;
-
-	spinlockAcquire(&tickslock);
-	xticks = ticks;
-	spinlockRelease(&tickslock);
-	return xticks;
+	return clockTicks();
 }
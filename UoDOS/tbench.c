@@ -0,0 +1,71 @@
+// tbench: Check and time threads, mutexes and the thread-safe allocator.
+//
+// Starts a number of threads that each lock a shared mutex, add one to a
+// shared counter and allocate and free a block, many times over, then checks
+// the counter and reports the clock ticks taken.  Usage: tbench [threads] [iterations]
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define MAXTHREADS	16
+
+static Mutex counterLock = MUTEX_INITIALISER;
+static volatile int counter;
+static int iterations;
+
+static void* worker(void *argument)
+{
+	int size = (int)argument;
+
+	for (int i = 0; i < iterations; i++)
+	{
+		mutexLock(&counterLock);
+		counter++;
+		mutexUnlock(&counterLock);
+		void *p = malloc(size);
+		if (p == 0)
+		{
+			return (void*)-1;
+		}
+		free(p);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	Thread threads[MAXTHREADS];
+	int threadCount = argc > 1 ? atoi(argv[1]) : 4;
+	int failed = 0;
+
+	iterations = argc > 2 ? atoi(argv[2]) : 10000;
+	if (threadCount < 1 || threadCount > MAXTHREADS)
+	{
+		printf("tbench: between 1 and %d threads\n", MAXTHREADS);
+		exit();
+	}
+	int start = uptime();
+	for (int i = 0; i < threadCount; i++)
+	{
+		if (threadCreate(&threads[i], worker, (void*)(16 << (i % 8))) < 0)
+		{
+			printf("tbench: cannot create thread %d\n", i);
+			exit();
+		}
+	}
+	for (int i = 0; i < threadCount; i++)
+	{
+		void *result;
+		if (threadJoin(&threads[i], &result) < 0 || result != 0)
+		{
+			failed++;
+		}
+	}
+	printf("%d threads x %d iterations: %d ticks\n", threadCount, iterations, uptime() - start);
+	if (failed || counter != threadCount * iterations)
+	{
+		printf("tbench: FAILED (counter %d, expected %d, %d threads failed)\n", counter, threadCount * iterations, failed);
+	}
+	exit();
+}
@@ -0,0 +1,382 @@
+// The clock and kernel timers.
+//
+// Time is kept by the time stamp counter, which timerInitialise calibrates
+// against channel 2 of the PIT at boot, along with the local APIC timer.
+// There is no periodic tick.  Each CPU keeps its pending timers in a
+// pairing heap ordered by deadline and sets its local APIC timer in one-shot
+// mode for whichever comes first: the earliest timer or, while there are
+// processes to run, the end of the current time slice.  When a CPU has
+// nothing to run, timerIdle stops the time slice and halts until the next
+// timer or other interrupt, so an idle CPU with no timers is not woken at all.
+//
+// There is no libgcc, so 64-bit division is only done by divide64 and
+// conversions between units use 32.32 fixed point multipliers.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "date.h"
+#include "timer.h"
+
+#define PIT_HZ				1193182						// Input clock of the PIT
+#define PIT_CALIBRATION		(PIT_HZ / 100)				// PIT counts in the calibration period
+#define CALIBRATION_NS		((uint64_t)PIT_CALIBRATION * 1000000000 / PIT_HZ)
+#define PIT_CHANNEL2		0x42
+#define PIT_COMMAND			0x43
+#define PIT_GATE			0x61						// Bit 0 gates channel 2, bit 5 is its output
+#define NEVER				0xFFFFFFFFFFFFFFFFULL
+#define MAXTIMERDELAY		1000000000ULL				// Keeps the local APIC count in 32 bits
+
+static uint64_t bootCycles;				// Time stamp counter at calibration
+static uint64_t nanosecondsPerCycle;	// 32.32 fixed point
+static uint64_t countsPerNanosecond;	// Local APIC timer counts, 32.32 fixed point
+static uint32_t bootSeconds;			// Real time at boot, in seconds since 1970
+
+static struct
+{
+	Spinlock			Lock;
+	Timer *				Timers;			// Root of the heap of pending timers
+	uint64_t			Programmed;		// Deadline the local APIC timer is set for
+} __attribute__((aligned(64))) perCpu[NCPU];
+
+// Divide a 64-bit number by a 32-bit one, returning the quotient and
+// optionally the remainder
+
+static uint64_t divide64(uint64_t dividend, uint32_t divisor, uint32_t * remainder)
+{
+	uint32_t high = dividend >> 32;
+	uint32_t quotientLow;
+	uint32_t rest;
+
+	asm("divl %4" : "=a" (quotientLow), "=d" (rest) : "a" ((uint32_t)dividend), "d" (high % divisor), "rm" (divisor));
+	if (remainder)
+	{
+		*remainder = rest;
+	}
+	return ((uint64_t)(high / divisor) << 32) | quotientLow;
+}
+
+// Multiply by a 32.32 fixed point factor, without needing a 128-bit product
+
+static uint64_t scale(uint64_t value, uint64_t factor)
+{
+	uint32_t valueHigh = value >> 32;
+	uint32_t valueLow = value;
+	uint32_t factorHigh = factor >> 32;
+	uint32_t factorLow = factor;
+
+	return ((uint64_t)(valueHigh * factorHigh) << 32) +
+		   (uint64_t)valueHigh * factorLow +
+		   (uint64_t)valueLow * factorHigh +
+		   (((uint64_t)valueLow * factorLow) >> 32);
+}
+
+// Convert a date from the real time clock to seconds since 1970
+
+static uint32_t epochSeconds(RtcDate * date)
+{
+	static const uint16_t daysBeforeMonth[12] = { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+	uint32_t days = 0;
+
+	for (uint32_t year = 1970; year < date->year; year++)
+	{
+		days += (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0)) ? 366 : 365;
+	}
+	if (date->month >= 1 && date->month <= 12)
+	{
+		days += daysBeforeMonth[date->month - 1];
+		if (date->month > 2 && date->year % 4 == 0 && (date->year % 100 != 0 || date->year % 400 == 0))
+		{
+			days++;
+		}
+	}
+	days += date->day - 1;
+	return ((days * 24 + date->hour) * 60 + date->minute) * 60 + date->second;
+}
+
+// Join two heaps, returning the new root.  Both must be non-empty and
+// not linked to anything else.
+
+static Timer * meld(Timer * a, Timer * b)
+{
+	if (b->Deadline < a->Deadline)
+	{
+		Timer * t = a;
+		a = b;
+		b = t;
+	}
+	b->Previous = a;
+	b->Next = a->Child;
+	if (a->Child)
+	{
+		a->Child->Previous = b;
+	}
+	a->Child = b;
+	return a;
+}
+
+// Combine a list of sibling heaps into one: meld them in pairs from left
+// to right, then meld the pairs together from right to left
+
+static Timer * mergePairs(Timer * first)
+{
+	Timer * pairs = 0;
+	Timer * result = 0;
+
+	while (first)
+	{
+		Timer * a = first;
+		Timer * b = a->Next;
+		first = b ? b->Next : 0;
+		a->Next = a->Previous = 0;
+		if (b)
+		{
+			b->Next = b->Previous = 0;
+			a = meld(a, b);
+		}
+		a->Next = pairs;
+		pairs = a;
+	}
+	while (pairs)
+	{
+		Timer * next = pairs->Next;
+		pairs->Next = 0;
+		result = result ? meld(result, pairs) : pairs;
+		pairs = next;
+	}
+	return result;
+}
+
+// Take a timer out of a CPU's heap.  Must hold the CPU's lock.
+
+static void removeTimer(int cpu, Timer * timer)
+{
+	if (timer == perCpu[cpu].Timers)
+	{
+		perCpu[cpu].Timers = mergePairs(timer->Child);
+	}
+	else
+	{
+		if (timer->Previous->Child == timer)
+		{
+			timer->Previous->Child = timer->Next;
+		}
+		else
+		{
+			timer->Previous->Next = timer->Next;
+		}
+		if (timer->Next)
+		{
+			timer->Next->Previous = timer->Previous;
+		}
+		Timer * children = mergePairs(timer->Child);
+		if (children)
+		{
+			perCpu[cpu].Timers = meld(perCpu[cpu].Timers, children);
+		}
+	}
+	timer->Cpu = -1;
+}
+
+// Set this CPU's local APIC timer for its earliest timer or, unless the
+// CPU is idle, the end of the time slice.  Must hold the CPU's lock.
+
+static void programTimer(int cpu, int idle)
+{
+	uint64_t now = clockNanoseconds();
+	uint64_t deadline = idle ? NEVER : now + TIMESLICE;
+	Timer * first = perCpu[cpu].Timers;
+
+	if (first && first->Deadline < deadline)
+	{
+		deadline = first->Deadline;
+	}
+	if (deadline == NEVER)
+	{
+		perCpu[cpu].Programmed = NEVER;
+		localApicSetTimer(0);
+		return;
+	}
+	uint64_t delay = deadline > now ? deadline - now : 0;
+	if (delay > MAXTIMERDELAY)
+	{
+		delay = MAXTIMERDELAY;
+	}
+	perCpu[cpu].Programmed = now + delay;
+	uint32_t count = scale(delay, countsPerNanosecond);
+	localApicSetTimer(count ? count : 1);
+}
+
+// Calibrate the time stamp counter and the local APIC timer by counting
+// how far they go while PIT channel 2 counts down for 10ms.  Called on
+// the boot CPU with interrupts off.
+
+void timerInitialise(void)
+{
+	RtcDate date;
+	uint32_t startCount;
+	uint64_t startCycles;
+	uint32_t spins = 0;
+
+	for (int i = 0; i < NCPU; i++)
+	{
+		spinlockInitialise(&perCpu[i].Lock, "timer");
+		perCpu[i].Programmed = NEVER;
+	}
+
+	// Channel 2 in mode 0 (interrupt on terminal count) with the speaker off.
+	// Its output goes high when the count reaches 0.
+	outputByteToPort(PIT_GATE, (inputByteFromPort(PIT_GATE) & ~0x02) | 0x01);
+	outputByteToPort(PIT_COMMAND, 0xB0);
+	outputByteToPort(PIT_CHANNEL2, PIT_CALIBRATION & 0xFF);
+	outputByteToPort(PIT_CHANNEL2, PIT_CALIBRATION >> 8);
+	localApicSetTimer(0xFFFFFFFF);
+	startCount = localApicTimerCount();
+	startCycles = readTimeStampCounter();
+	while ((inputByteFromPort(PIT_GATE) & 0x20) == 0)
+	{
+		if (++spins == 0x10000000)
+		{
+			panic("timerInitialise: no PIT");
+		}
+	}
+	bootCycles = readTimeStampCounter();
+	countsPerNanosecond = divide64((uint64_t)(startCount - localApicTimerCount()) << 32, CALIBRATION_NS, 0);
+	nanosecondsPerCycle = divide64(CALIBRATION_NS << 32, (uint32_t)(bootCycles - startCycles), 0);
+	localApicSetTimer(0);
+
+	cmosTime(&date);
+	bootSeconds = epochSeconds(&date);
+}
+
+// The time since boot in nanoseconds
+
+uint64_t clockNanoseconds(void)
+{
+	return scale(readTimeStampCounter() - bootCycles, nanosecondsPerCycle);
+}
+
+// The time since boot in ticks, the units of the sleep and uptime system calls
+
+uint32_t clockTicks(void)
+{
+	return divide64(clockNanoseconds(), 1000000000 / TICKSPERSECOND, 0);
+}
+
+// Read one of the clocks.  Returns -1 if there is no such clock.
+
+int clockGetTime(int clock, Timespec * time)
+{
+	uint32_t nanoseconds;
+	uint32_t seconds = divide64(clockNanoseconds(), 1000000000, &nanoseconds);
+
+	switch (clock)
+	{
+		case CLOCK_REALTIME:
+			seconds += bootSeconds;
+			break;
+
+		case CLOCK_MONOTONIC:
+			break;
+
+		default:
+			return -1;
+	}
+	time->Seconds = seconds;
+	time->Nanoseconds = nanoseconds;
+	return 0;
+}
+
+// Sleep for the given number of nanoseconds.  Returns -1 if the process
+// is killed first.  The timer goes in this CPU's heap, and is still taken
+// out of it with this CPU's lock if the process wakes on another CPU.
+
+int timerSleep(uint64_t duration)
+{
+	Timer timer;
+	int cpu;
+
+	pushCli();
+	cpu = cpuId();
+	spinlockAcquire(&perCpu[cpu].Lock);
+	popCli();
+
+	timer.Deadline = clockNanoseconds() + duration;
+	timer.Cpu = cpu;
+	timer.Child = timer.Next = timer.Previous = 0;
+	perCpu[cpu].Timers = perCpu[cpu].Timers ? meld(perCpu[cpu].Timers, &timer) : &timer;
+	if (timer.Deadline < perCpu[cpu].Programmed)
+	{
+		programTimer(cpu, 0);
+	}
+	while (timer.Cpu >= 0 && !myProcess()->IsKilled)
+	{
+		sleep(&timer, &perCpu[cpu].Lock);
+	}
+	if (timer.Cpu >= 0)
+	{
+		removeTimer(cpu, &timer);
+	}
+	spinlockRelease(&perCpu[cpu].Lock);
+	return myProcess()->IsKilled ? -1 : 0;
+}
+
+// Local APIC timer interrupt: wake the sleepers whose timers have expired
+// and set the timer for the next deadline or time slice
+
+void timerInterrupt(void)
+{
+	int cpu = cpuId();
+	uint64_t now = clockNanoseconds();
+	Timer * first;
+
+	spinlockAcquire(&perCpu[cpu].Lock);
+	while ((first = perCpu[cpu].Timers) != 0 && first->Deadline <= now)
+	{
+		removeTimer(cpu, first);
+		wakeup(first);
+	}
+	programTimer(cpu, 0);
+	spinlockRelease(&perCpu[cpu].Lock);
+}
+
+// Start this CPU's first time slice, before it enters the scheduler.  From
+// then on each timer interrupt and each return from timerIdle sets the timer
+// again, so the running process can always be preempted.  (The scheduler
+// cannot do this on each switch, since it holds processTable.Lock, and
+// timerSleep and timerInterrupt take that lock while holding a timer lock.)
+
+void timerStart(void)
+{
+	int cpu;
+
+	pushCli();
+	cpu = cpuId();
+	spinlockAcquire(&perCpu[cpu].Lock);
+	programTimer(cpu, 0);
+	spinlockRelease(&perCpu[cpu].Lock);
+	popCli();
+}
+
+// Called by the scheduler with interrupts off when it has nothing to run.
+// Sets the timer for the earliest timer only and halts until an interrupt,
+// then restarts the time slice in case the interrupt made a process runnable.
+// sti takes effect after the next instruction, so no interrupt can slip in
+// between it and the hlt and be missed.
+
+void timerIdle(void)
+{
+	int cpu = cpuId();
+
+	spinlockAcquire(&perCpu[cpu].Lock);
+	programTimer(cpu, 1);
+	spinlockRelease(&perCpu[cpu].Lock);
+	asm volatile("sti; hlt; cli");
+	spinlockAcquire(&perCpu[cpu].Lock);
+	programTimer(cpu, 0);
+	spinlockRelease(&perCpu[cpu].Lock);
+}
@@ -0,0 +1,24 @@
+// Clocks for the clock_gettime system call
+
+#define CLOCK_REALTIME		0	// Seconds since 1970, from the real time clock at boot
+#define CLOCK_MONOTONIC		1	// Time since boot
+
+// A time or duration, as used by the clock_gettime and nanosleep system calls
+
+struct _Timespec
+{
+	uint32_t	Seconds;
+	uint32_t	Nanoseconds;
+};
+
+// A one-shot kernel timer (see timer.c).  Each CPU keeps its pending timers
+// in a pairing heap ordered by deadline, so the earliest is always at the root.
+
+struct _Timer
+{
+	uint64_t			Deadline;		// Nanoseconds since boot when it expires
+	int					Cpu;			// CPU whose heap it is in, or -1 once it has expired
+	struct _Timer *		Child;			// First of the timers that expire no earlier than this one
+	struct _Timer *		Next;			// Next sibling
+	struct _Timer *		Previous;		// Previous sibling, or the parent for the first child
+};
@@ -0,0 +1,466 @@
+// In-memory file system.
+//
+// tmpfs keeps files and directories entirely in physical pages from kalloc.c
+// and never touches the disk, so it suits scratch files and pipelines.  It is
+// mounted at /tmp (see forkret in proc.c).
+//
+// Every file or directory is a TmpfsNode.  Nodes are carved out of pages and
+// recycled through a free list.  A directory holds a linked list of its
+// children in the order they were created.  Ids only go up, so the list is
+// in Id order too, and a directory read position is the Id of the last entry
+// read, which stays valid as entries are added and removed.  A file's data is held in pages that are listed in an index page,
+// which limits a file to TMPFS_MAXPAGES pages; pages that have never been
+// written are not allocated and read as zeros.
+//
+// Since the nodes are already in memory there is nothing to gain from sharing
+// vnodes, so each lookup returns a vnode of its own that holds a reference to
+// the node.  A node is freed once it has been removed from its directory and
+// the last vnode referring to it has been released.
+//
+// A single spinlock protects the directory tree, the reference counts and
+// the free list of every tmpfs mount.  The data of each file is protected by
+// a sleep lock in its node instead, so that copying to or from a user buffer
+// does not happen with interrupts off and can wait for a page fault.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "dirent.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "vfs.h"
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+#define TMPFS_MAXPAGES		(PGSIZE / sizeof(char *))	// Pages in the largest file
+
+struct _TmpfsNode
+{
+	char					Name[DIRENTNAMESIZE];
+	short					Type;				// T_FILE or T_DIR
+	int						Linked;				// 1 while the node is in a directory
+	int						References;			// Vnodes referring to the node
+	uint32_t				Id;
+	uint32_t				Size;				// Bytes in a file, entries in a directory
+	Sleeplock				DataLock;			// Protects Size and Pages of a file
+	char **					Pages;				// File data (see above), or 0
+	TmpfsNode *				Children;			// Directory contents
+	TmpfsNode *				Next;				// Next in the parent directory or the free list
+};
+
+#define NODES_PER_PAGE		(PGSIZE / sizeof(TmpfsNode))
+
+struct
+{
+	Spinlock		Lock;
+	uint32_t		NextId;
+	TmpfsNode *		FreeNodes;
+} tmpfs;
+
+void tmpfsInitialise(void)
+{
+	spinlockInitialise(&tmpfs.Lock, "tmpfs");
+	tmpfs.NextId = 1;
+}
+
+// Allocate a node.  Caller must hold the lock.
+
+static TmpfsNode * tmpfsAllocateNode(const char * name, short type)
+{
+	TmpfsNode * node;
+	char * page;
+
+	if (tmpfs.FreeNodes == 0)
+	{
+		if ((page = allocatePhysicalMemoryPage()) == 0)
+		{
+			return 0;
+		}
+		for (int i = 0; i < NODES_PER_PAGE; i++)
+		{
+			node = (TmpfsNode *)page + i;
+			node->Next = tmpfs.FreeNodes;
+			tmpfs.FreeNodes = node;
+		}
+	}
+	node = tmpfs.FreeNodes;
+	tmpfs.FreeNodes = node->Next;
+	memset(node, 0, sizeof(TmpfsNode));
+	safestrcpy(node->Name, name, DIRENTNAMESIZE);
+	sleeplockInitialise(&node->DataLock, "tmpfsdata");
+	node->Type = type;
+	node->Id = tmpfs.NextId++;
+	return node;
+}
+
+// Free the data pages of a file from page first onwards.  Caller must hold
+// the node's data lock, or the lock if nothing refers to the node.
+
+static void tmpfsFreePages(TmpfsNode * node, uint32_t first)
+{
+	if (node->Pages == 0)
+	{
+		return;
+	}
+	for (uint32_t i = first; i < TMPFS_MAXPAGES; i++)
+	{
+		if (node->Pages[i])
+		{
+			freePhysicalMemoryPage(node->Pages[i]);
+			node->Pages[i] = 0;
+		}
+	}
+	if (first == 0)
+	{
+		freePhysicalMemoryPage((char *)node->Pages);
+		node->Pages = 0;
+	}
+}
+
+// Free a node if nothing refers to it any more.  Caller must hold the lock.
+
+static void tmpfsPutNode(TmpfsNode * node)
+{
+	if (node->Linked || node->References > 0)
+	{
+		return;
+	}
+	tmpfsFreePages(node, 0);
+	node->Next = tmpfs.FreeNodes;
+	tmpfs.FreeNodes = node;
+}
+
+// Return a new vnode for a node.  Must be called without the lock held.
+
+static Vnode * tmpfsGetVnode(Mount * mount, TmpfsNode * node)
+{
+	Vnode template;
+	Vnode * vnode;
+
+	memset(&template, 0, sizeof(Vnode));
+	template.Type = node->Type;
+	template.Data.Tmpfs = node;
+	spinlockAcquire(&tmpfs.Lock);
+	node->References++;
+	spinlockRelease(&tmpfs.Lock);
+	if ((vnode = vnodeGet(mount, VNODE_NOID, &template)) == 0)
+	{
+		spinlockAcquire(&tmpfs.Lock);
+		node->References--;
+		tmpfsPutNode(node);
+		spinlockRelease(&tmpfs.Lock);
+	}
+	return vnode;
+}
+
+// Find a name in a directory.  Caller must hold the lock.
+
+static TmpfsNode * tmpfsFindChild(TmpfsNode * directory, const char * name, TmpfsNode *** link)
+{
+	TmpfsNode ** p;
+
+	for (p = &directory->Children; *p; p = &(*p)->Next)
+	{
+		if (strncmp((*p)->Name, name, DIRENTNAMESIZE) == 0)
+		{
+			if (link)
+			{
+				*link = p;
+			}
+			return *p;
+		}
+	}
+	return 0;
+}
+
+static int tmpfsMount(Mount * mount)
+{
+	TmpfsNode * root;
+
+	spinlockAcquire(&tmpfs.Lock);
+	root = tmpfsAllocateNode("", T_DIR);
+	if (root)
+	{
+		// The root is never in a directory, but must never be freed
+		root->Linked = 1;
+	}
+	spinlockRelease(&tmpfs.Lock);
+	if (root == 0)
+	{
+		return -1;
+	}
+	mount->Private = root;
+	mount->Root = tmpfsGetVnode(mount, root);
+	return mount->Root ? 0 : -1;
+}
+
+static int tmpfsLookup(Vnode * directory, const char * name, Vnode ** result)
+{
+	TmpfsNode * node;
+
+	spinlockAcquire(&tmpfs.Lock);
+	node = tmpfsFindChild(directory->Data.Tmpfs, name, 0);
+	if (node)
+	{
+		// Hold the node while we get a vnode for it
+		node->References++;
+	}
+	spinlockRelease(&tmpfs.Lock);
+	if (node == 0)
+	{
+		return -1;
+	}
+	*result = tmpfsGetVnode(directory->Mount, node);
+	spinlockAcquire(&tmpfs.Lock);
+	node->References--;
+	tmpfsPutNode(node);
+	spinlockRelease(&tmpfs.Lock);
+	return *result ? 0 : -1;
+}
+
+static int tmpfsRead(Vnode * vnode, uint32_t position, char * buffer, uint32_t length)
+{
+	TmpfsNode * node = vnode->Data.Tmpfs;
+	uint32_t totalRead = 0;
+	uint32_t offset;
+	uint32_t readLength;
+	char * page;
+
+	sleeplockAcquire(&node->DataLock);
+	if (position < node->Size)
+	{
+		length = min(length, node->Size - position);
+		while (totalRead < length)
+		{
+			offset = position % PGSIZE;
+			readLength = min(length - totalRead, PGSIZE - offset);
+			page = node->Pages ? node->Pages[position / PGSIZE] : 0;
+			if (page)
+			{
+				memmove(buffer, page + offset, readLength);
+			}
+			else
+			{
+				memset(buffer, 0, readLength);
+			}
+			buffer += readLength;
+			position += readLength;
+			totalRead += readLength;
+		}
+	}
+	sleeplockRelease(&node->DataLock);
+	return totalRead;
+}
+
+static int tmpfsWrite(Vnode * vnode, uint32_t position, char * buffer, uint32_t length)
+{
+	TmpfsNode * node = vnode->Data.Tmpfs;
+	uint32_t totalWritten = 0;
+	uint32_t offset;
+	uint32_t writeLength;
+	char ** page;
+
+	if (position >= TMPFS_MAXPAGES * PGSIZE)
+	{
+		return -1;
+	}
+	length = min(length, TMPFS_MAXPAGES * PGSIZE - position);
+	sleeplockAcquire(&node->DataLock);
+	if (node->Pages == 0)
+	{
+		if ((node->Pages = (char **)allocatePhysicalMemoryPage()) == 0)
+		{
+			sleeplockRelease(&node->DataLock);
+			return -1;
+		}
+		memset(node->Pages, 0, PGSIZE);
+	}
+	while (totalWritten < length)
+	{
+		offset = position % PGSIZE;
+		writeLength = min(length - totalWritten, PGSIZE - offset);
+		page = &node->Pages[position / PGSIZE];
+		if (*page == 0)
+		{
+			if ((*page = allocatePhysicalMemoryPage()) == 0)
+			{
+				break;
+			}
+			memset(*page, 0, PGSIZE);
+		}
+		memmove(*page + offset, buffer, writeLength);
+		buffer += writeLength;
+		position += writeLength;
+		totalWritten += writeLength;
+	}
+	if (position > node->Size)
+	{
+		node->Size = position;
+	}
+	sleeplockRelease(&node->DataLock);
+	return (totalWritten > 0 || length == 0) ? totalWritten : -1;
+}
+
+static int tmpfsTruncate(Vnode * vnode, uint32_t size)
+{
+	TmpfsNode * node = vnode->Data.Tmpfs;
+
+	if (size > TMPFS_MAXPAGES * PGSIZE)
+	{
+		return -1;
+	}
+	sleeplockAcquire(&node->DataLock);
+	if (size < node->Size && node->Pages)
+	{
+		// Free the pages past the end and clear the rest of the last page,
+		// so that growing the file again reads zeros
+		tmpfsFreePages(node, (size + PGSIZE - 1) / PGSIZE);
+		if (size % PGSIZE && node->Pages[size / PGSIZE])
+		{
+			memset(node->Pages[size / PGSIZE] + size % PGSIZE, 0, PGSIZE - size % PGSIZE);
+		}
+	}
+	node->Size = size;
+	sleeplockRelease(&node->DataLock);
+	return 0;
+}
+
+// *position is the Id of the last entry returned, or 0 at the start.  The
+// entries are gathered a few at a time into a buffer on the stack and copied
+// to dirents, which may be user memory, with the lock released
+
+static int tmpfsReadDirectory(Vnode * vnode, uint32_t * position, Dirent * dirents, int count)
+{
+	Dirent batch[8];
+	TmpfsNode * node;
+	int filled = 0;
+	int gathered;
+
+	do
+	{
+		gathered = 0;
+		spinlockAcquire(&tmpfs.Lock);
+		for (node = vnode->Data.Tmpfs->Children; node && gathered < NELEM(batch) && filled + gathered < count; node = node->Next)
+		{
+			if (node->Id <= *position)
+			{
+				continue;
+			}
+			Dirent * dirent = &batch[gathered++];
+			safestrcpy(dirent->name, node->Name, DIRENTNAMESIZE);
+			dirent->attrib = node->Type == T_DIR ? ATTRIB_DIRECTORY : 0;
+			dirent->type = node->Type;
+			dirent->ino = node->Id;
+			dirent->size = node->Type == T_DIR ? 0 : node->Size;
+			dirent->mtime = 0;
+			*position = node->Id;
+		}
+		spinlockRelease(&tmpfs.Lock);
+		memmove(&dirents[filled], batch, gathered * sizeof(Dirent));
+		filled += gathered;
+	} while (gathered == NELEM(batch) && filled < count);
+	return filled;
+}
+
+static int tmpfsStat(Vnode * vnode, Stat * st)
+{
+	TmpfsNode * node = vnode->Data.Tmpfs;
+	Stat copy;
+
+	memset(&copy, 0, sizeof(copy));
+	spinlockAcquire(&tmpfs.Lock);
+	copy.type = node->Type;
+	copy.ino = node->Id;
+	copy.nlink = node->Linked;
+	copy.size = node->Type == T_DIR ? 0 : node->Size;
+	spinlockRelease(&tmpfs.Lock);
+	*st = copy;			// st may be user memory, so not with the lock held
+	return 0;
+}
+
+// Called by vnodePut with the vnode cache lock held
+
+static void tmpfsRelease(Vnode * vnode)
+{
+	TmpfsNode * node = vnode->Data.Tmpfs;
+
+	spinlockAcquire(&tmpfs.Lock);
+	node->References--;
+	tmpfsPutNode(node);
+	spinlockRelease(&tmpfs.Lock);
+}
+
+static int tmpfsCreate(Vnode * directory, const char * name, short type, Vnode ** result)
+{
+	TmpfsNode * parent = directory->Data.Tmpfs;
+	TmpfsNode * node;
+	TmpfsNode ** link;
+
+	if (*name == 0 || strlen(name) >= DIRENTNAMESIZE)
+	{
+		return -1;
+	}
+	spinlockAcquire(&tmpfs.Lock);
+	if (!parent->Linked || tmpfsFindChild(parent, name, 0) || (node = tmpfsAllocateNode(name, type)) == 0)
+	{
+		spinlockRelease(&tmpfs.Lock);
+		return -1;
+	}
+	node->Linked = 1;
+	// Add it at the end, keeping the children in Id order
+	for (link = &parent->Children; *link; link = &(*link)->Next)
+	{
+	}
+	node->Next = 0;
+	*link = node;
+	parent->Size++;
+	// Hold the node while we get a vnode for it, since it can be removed
+	// as soon as the lock is released
+	node->References++;
+	spinlockRelease(&tmpfs.Lock);
+	*result = tmpfsGetVnode(directory->Mount, node);
+	spinlockAcquire(&tmpfs.Lock);
+	node->References--;
+	tmpfsPutNode(node);
+	spinlockRelease(&tmpfs.Lock);
+	return *result ? 0 : -1;
+}
+
+static int tmpfsRemove(Vnode * directory, const char * name)
+{
+	TmpfsNode * parent = directory->Data.Tmpfs;
+	TmpfsNode * node;
+	TmpfsNode ** link;
+
+	spinlockAcquire(&tmpfs.Lock);
+	node = tmpfsFindChild(parent, name, &link);
+	if (node == 0 || (node->Type == T_DIR && node->Children))
+	{
+		spinlockRelease(&tmpfs.Lock);
+		return -1;
+	}
+	*link = node->Next;
+	parent->Size--;
+	node->Linked = 0;
+	tmpfsPutNode(node);
+	spinlockRelease(&tmpfs.Lock);
+	return 0;
+}
+
+FileSystemOperations tmpfsOperations =
+{
+	.Name = "tmpfs",
+	.Mount = tmpfsMount,
+	.Lookup = tmpfsLookup,
+	.Read = tmpfsRead,
+	.Write = tmpfsWrite,
+	.ReadDirectory = tmpfsReadDirectory,
+	.Stat = tmpfsStat,
+	.Release = tmpfsRelease,
+	.Create = tmpfsCreate,
+	.Remove = tmpfsRemove,
+	.Truncate = tmpfsTruncate,
+};
@@ -0,0 +1,424 @@
+// Benchmark the FAT file system code on the host.
+//
+// This is a host program.  The makefile builds it from this file, fshost.c
+// and the kernel's fs.c, dirindex.c, vfs.c and bio.c.  fshost.c replaces the
+// rest of the kernel with stubs; its ideReadWrite reads sectors from image
+// files, so the real buffer cache, cluster chain and directory code is
+// measured, without booting anything.
+//
+// It makes a random set of files (large files, deep paths, a directory
+// with many entries and a badly fragmented file), builds FAT12, FAT16 and
+// FAT32 images of them with mkfatimg, and mounts the images at /fat12,
+// /fat16 and /fat32.  For each image it then times random path lookups,
+// sequential reads and random reads.  Everything read is compared with
+// what was written, so a run also checks that the file system code works.
+//
+// Usage: fsbench [-s seed] [-m mkfatimg] [-k]
+//
+//	-s seed		Seed for the random file set (default 1)
+//	-m program	The image builder (default ./mkfatimg.exe)
+//	-k			Keep the files and images (they are made in a directory under /tmp)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "fshost.h"
+
+#define MAXIMAGES		3
+#define MAXFILES		1024
+#define MAXCOMMAND		65536
+#define WIDEFILES		200
+#define DEEPLEVELS		8
+#define FRAGHOLES		400
+#define SECTORSIZE		512
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+typedef struct _TestFile
+{
+	char		Path[64];		// Path within the image
+	uint8_t *	Data;
+	uint32_t	Size;
+	bool		Large;			// Include in the read tests
+} TestFile;
+
+static struct
+{
+	const char *	Name;
+	const char *	Options;
+} imageTypes[MAXIMAGES] =
+{
+	{ "fat12", "-f fat12 -s 32768" },
+	{ "fat16", "-f fat16 -s 32768" },
+	{ "fat32", "-f fat32 -s 70000 -c 1" },
+};
+
+static int imageFiles[MAXIMAGES];
+static TestFile testFiles[MAXFILES];
+static int testFileCount;
+static int hostFileCount;
+static char workDirectory[64];
+static uint64_t randomState;
+static uint64_t sectorReads;
+
+// Functions used by fshost.c
+
+void fsHostReadSector(unsigned device, unsigned sector, void * buffer)
+{
+	if (pread(imageFiles[device], buffer, SECTORSIZE, (off_t)sector * SECTORSIZE) != SECTORSIZE)
+	{
+		fsHostPanic("cannot read sector");
+	}
+	sectorReads++;
+}
+
+void fsHostWriteSector(unsigned device, unsigned sector, const void * buffer)
+{
+	if (pwrite(imageFiles[device], buffer, SECTORSIZE, (off_t)sector * SECTORSIZE) != SECTORSIZE)
+	{
+		fsHostPanic("cannot write sector");
+	}
+}
+
+void fsHostPrint(const char * message)
+{
+	fputs(message, stdout);
+}
+
+void fsHostPanic(const char * message)
+{
+	printf("fsbench: panic: %s\n", message);
+	exit(1);
+}
+
+void * fsHostAllocatePage(void)
+{
+	return aligned_alloc(4096, 4096);
+}
+
+void fsHostFreePage(void * page)
+{
+	free(page);
+}
+
+static uint32_t randomNumber(uint32_t limit)
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return (uint32_t)(randomState >> 16) % limit;
+}
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void fail(const char * message, const char * detail)
+{
+	printf("fsbench: FAILED: %s %s\n", message, detail);
+	exit(1);
+}
+
+// Add a file to the set, write it to the work directory and add it to the
+// image builder's command line
+
+static TestFile * addTestFile(char * command, const char * path, uint32_t size, bool large)
+{
+	char hostName[128];
+	TestFile * file = &testFiles[testFileCount];
+
+	if (testFileCount >= MAXFILES)
+	{
+		fail("too many files", path);
+	}
+	snprintf(file->Path, sizeof(file->Path), "%s", path);
+	file->Size = size;
+	file->Large = large;
+	file->Data = malloc(size + 1);
+	for (uint32_t i = 0; i < size; i++)
+	{
+		file->Data[i] = randomNumber(256);
+	}
+	snprintf(hostName, sizeof(hostName), "%s/f%d", workDirectory, hostFileCount++);
+	FILE * host = fopen(hostName, "wb");
+	if (host == NULL || fwrite(file->Data, 1, size, host) != size || fclose(host) != 0)
+	{
+		fail("cannot write", hostName);
+	}
+	snprintf(command + strlen(command), MAXCOMMAND - strlen(command), " %s=%s", hostName, path);
+	testFileCount++;
+	return file;
+}
+
+static void run(const char * command)
+{
+	if (system(command) != 0)
+	{
+		fail("command failed:", command);
+	}
+}
+
+// Make the file set and build the images.  The fragmented file is made by
+// filling part of the disk with single cluster files, emptying every other
+// one and then adding the file, which goes into the holes since clusters
+// are allocated first fit.
+
+static void makeImages(const char * mkfatimg)
+{
+	char * files = calloc(MAXCOMMAND, 1);
+	char * holes = calloc(MAXCOMMAND, 1);
+	char * command = malloc(MAXCOMMAND * 3);
+	char path[64];
+
+	for (int i = 0; i < 4; i++)
+	{
+		snprintf(path, sizeof(path), "/large/file%d.bin", i);
+		addTestFile(files, path, 100000 + randomNumber(1900000), true);
+	}
+	for (int i = 0; i < WIDEFILES; i++)
+	{
+		snprintf(path, sizeof(path), "/wide/w%d.txt", i);
+		addTestFile(files, path, randomNumber(3000), false);
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		int length = 0;
+		for (int level = 0; level < DEEPLEVELS; level++)
+		{
+			length += snprintf(path + length, sizeof(path) - length, "/d%d", level);
+		}
+		snprintf(path + length, sizeof(path) - length, "/deep%d.txt", i);
+		addTestFile(files, path, randomNumber(10000), false);
+	}
+	for (int i = 0; i < FRAGHOLES; i++)
+	{
+		snprintf(path, sizeof(path), "/frag/h%d.bin", i);
+		addTestFile(i & 1 ? files : holes, path, 512, false);
+	}
+	for (int type = 0; type < MAXIMAGES; type++)
+	{
+		snprintf(command, MAXCOMMAND * 3, "%s %s %s/%s.img %s %s > /dev/null", mkfatimg, imageTypes[type].Options, workDirectory, imageTypes[type].Name, files, holes);
+		run(command);
+	}
+
+	// Empty the even numbered hole files and add the fragmented file
+	for (int i = 0; i < testFileCount; i++)
+	{
+		TestFile * testFile = &testFiles[i];
+		if (strncmp(testFile->Path, "/frag/h", 7) == 0 && (atoi(testFile->Path + 7) & 1) == 0 && testFile->Size > 0)
+		{
+			snprintf(path, sizeof(path), "%s", testFile->Path);
+			free(testFile->Data);
+			*testFile = testFiles[--testFileCount];
+			addTestFile(files, path, 0, false);
+			i--;
+		}
+	}
+	addTestFile(files, "/frag/big.bin", 1000000, true);
+	for (int type = 0; type < MAXIMAGES; type++)
+	{
+		snprintf(command, MAXCOMMAND * 3, "%s %s %s/%s.img %s > /dev/null", mkfatimg, imageTypes[type].Options, workDirectory, imageTypes[type].Name, files);
+		run(command);
+	}
+	free(files);
+	free(holes);
+	free(command);
+}
+
+static void * openTestFile(const char * mountPath, TestFile * testFile)
+{
+	char path[128];
+
+	snprintf(path, sizeof(path), "%s%s", mountPath, testFile->Path);
+	void * file = fsHostOpen(path);
+	if (file == 0)
+	{
+		fail("cannot open", path);
+	}
+	return file;
+}
+
+static void benchmarkLookups(const char * mountPath, int count)
+{
+	char path[128];
+	uint64_t reads = sectorReads;
+	double start = now();
+
+	for (int i = 0; i < count; i++)
+	{
+		TestFile * testFile = &testFiles[randomNumber(testFileCount)];
+		if (i % 10 == 0)
+		{
+			// Look for a file that is not there, in the same directory
+			int directoryLength = strrchr(testFile->Path, '/') - testFile->Path;
+			snprintf(path, sizeof(path), "%s%.*s/missing.txt", mountPath, directoryLength, testFile->Path);
+			if (fsHostOpen(path) != 0)
+			{
+				fail("found missing file", path);
+			}
+			continue;
+		}
+		void * file = openTestFile(mountPath, testFile);
+		if (fsHostSize(file) != (int)testFile->Size)
+		{
+			fail("wrong size", testFile->Path);
+		}
+		fsHostClose(file);
+	}
+	double elapsed = now() - start;
+	printf("  lookups:          %10.0f per second (%llu sector reads)\n", count / elapsed, (unsigned long long)(sectorReads - reads));
+}
+
+static void benchmarkSequentialReads(const char * mountPath, int chunkSize)
+{
+	static char buffer[65536];
+	uint64_t reads = sectorReads;
+	uint64_t total = 0;
+	double start = now();
+
+	for (int i = 0; i < testFileCount; i++)
+	{
+		TestFile * testFile = &testFiles[i];
+		if (!testFile->Large)
+		{
+			continue;
+		}
+		void * file = openTestFile(mountPath, testFile);
+		uint32_t position = 0;
+		int length;
+		while ((length = fsHostRead(file, buffer, chunkSize)) > 0)
+		{
+			if (position + length > testFile->Size || memcmp(buffer, testFile->Data + position, length) != 0)
+			{
+				fail("wrong data read from", testFile->Path);
+			}
+			position += length;
+		}
+		if (position != testFile->Size)
+		{
+			fail("short read from", testFile->Path);
+		}
+		total += position;
+		fsHostClose(file);
+	}
+	double elapsed = now() - start;
+	printf("  sequential (%5d): %9.1f MB/s (%llu sector reads)\n", chunkSize, total / elapsed / 1e6, (unsigned long long)(sectorReads - reads));
+}
+
+static void benchmarkRandomReads(const char * mountPath, int count)
+{
+	static char buffer[65536];
+	uint64_t reads = sectorReads;
+	uint64_t total = 0;
+	double start = now();
+	int large[MAXFILES];
+	int largeCount = 0;
+
+	for (int i = 0; i < testFileCount; i++)
+	{
+		if (testFiles[i].Large)
+		{
+			large[largeCount++] = i;
+		}
+	}
+	for (int i = 0; i < count; i++)
+	{
+		TestFile * testFile = &testFiles[large[randomNumber(largeCount)]];
+		void * file = openTestFile(mountPath, testFile);
+		for (int j = 0; j < 16; j++)
+		{
+			uint32_t position = randomNumber(testFile->Size);
+			uint32_t length = 1 + randomNumber(sizeof(buffer));
+			uint32_t expected = min(length, testFile->Size - position);
+			fsHostSeek(file, position);
+			if (fsHostRead(file, buffer, length) != expected || memcmp(buffer, testFile->Data + position, expected) != 0)
+			{
+				fail("wrong data read from", testFile->Path);
+			}
+			total += expected;
+		}
+		fsHostClose(file);
+	}
+	double elapsed = now() - start;
+	printf("  random reads:     %10.1f MB/s (%llu sector reads)\n", total / elapsed / 1e6, (unsigned long long)(sectorReads - reads));
+}
+
+int main(int argc, char ** argv)
+{
+	const char * mkfatimg = "./mkfatimg.exe";
+	uint32_t seed = 1;
+	bool keep = false;
+	char path[128];
+	int option;
+
+	while ((option = getopt(argc, argv, "s:m:k")) != -1)
+	{
+		switch (option)
+		{
+			case 's':
+				seed = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'm':
+				mkfatimg = optarg;
+				break;
+
+			case 'k':
+				keep = true;
+				break;
+
+			default:
+				fprintf(stderr, "Usage: fsbench [-s seed] [-m mkfatimg] [-k]\n");
+				return 1;
+		}
+	}
+	randomState = 0x9E3779B97F4A7C15ULL ^ seed;
+	strcpy(workDirectory, "/tmp/fsbenchXXXXXX");
+	if (mkdtemp(workDirectory) == NULL)
+	{
+		fail("cannot make", workDirectory);
+	}
+	makeImages(mkfatimg);
+
+	fsHostInitialise();
+	for (int type = 0; type < MAXIMAGES; type++)
+	{
+		snprintf(path, sizeof(path), "%s/%s.img", workDirectory, imageTypes[type].Name);
+		imageFiles[type] = open(path, O_RDWR);
+		if (imageFiles[type] < 0)
+		{
+			fail("cannot open", path);
+		}
+		snprintf(path, sizeof(path), "/%s", imageTypes[type].Name);
+		if (fsHostMount(path, type) < 0)
+		{
+			fail("cannot mount", path);
+		}
+	}
+	printf("fsbench: seed %u, %d files in %s\n", seed, testFileCount, workDirectory);
+	for (int type = 0; type < MAXIMAGES; type++)
+	{
+		snprintf(path, sizeof(path), "/%s", imageTypes[type].Name);
+		printf("%s:\n", imageTypes[type].Name);
+		benchmarkLookups(path, 20000);
+		benchmarkSequentialReads(path, 512);
+		benchmarkSequentialReads(path, 4096);
+		benchmarkSequentialReads(path, 65536);
+		benchmarkRandomReads(path, 200);
+	}
+	if (!keep)
+	{
+		snprintf(path, sizeof(path), "rm -rf %s", workDirectory);
+		run(path);
+	}
+	return 0;
+}
@@ -0,0 +1,227 @@
+// Kernel side of fsbench (see fsbench.c).
+//
+// Stubs for the parts of the kernel that fs.c, dirindex.c, vfs.c and bio.c
+// use, and wrappers that let fsbench.c call the VFS.  There is only one
+// thread, so the locks just check that they are not taken twice.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "rwlock.h"
+#include "fs.h"
+#include "buf.h"
+#include "file.h"
+#include "vfs.h"
+#include "fshost.h"
+
+#include <stdarg.h>
+
+int vsnprintf(char *, unsigned long, const char *, va_list);
+
+void ideReadWrite(DiskBuffer * b)
+{
+	if (b->Flags & B_DIRTY)
+	{
+		fsHostWriteSector(b->Device, b->SectorNumber, b->Data);
+		b->Flags &= ~B_DIRTY;
+	}
+	else
+	{
+		fsHostReadSector(b->Device, b->SectorNumber, b->Data);
+	}
+	b->Flags |= B_VALID;
+}
+
+void spinlockInitialise(Spinlock * lock, char * name)
+{
+	lock->Owner = 0;
+	lock->Next = 0;
+	lock->Name = name;
+}
+
+void spinlockAcquire(Spinlock * lock)
+{
+	if (lock->Owner != lock->Next)
+	{
+		panic(lock->Name);
+	}
+	lock->Next++;
+}
+
+void spinlockRelease(Spinlock * lock)
+{
+	lock->Owner++;
+}
+
+void readWriteLockInitialise(ReadWriteLock * lock, char * name)
+{
+	lock->State = 0;
+	lock->Name = name;
+}
+
+void readLockAcquire(ReadWriteLock * lock)
+{
+	if (lock->State & RWLOCK_WRITER)
+	{
+		panic(lock->Name);
+	}
+	lock->State++;
+}
+
+void readLockRelease(ReadWriteLock * lock)
+{
+	lock->State--;
+}
+
+void writeLockAcquire(ReadWriteLock * lock)
+{
+	if (lock->State)
+	{
+		panic(lock->Name);
+	}
+	lock->State = RWLOCK_WRITER;
+}
+
+void writeLockRelease(ReadWriteLock * lock)
+{
+	lock->State = 0;
+}
+
+void sleeplockInitialise(Sleeplock * lock, char * name)
+{
+	lock->Locked = 0;
+	lock->Name = name;
+}
+
+void sleeplockAcquire(Sleeplock * lock)
+{
+	if (lock->Locked)
+	{
+		panic(lock->Name);
+	}
+	lock->Locked = 1;
+}
+
+void sleeplockRelease(Sleeplock * lock)
+{
+	lock->Locked = 0;
+}
+
+int isHoldingSleeplock(Sleeplock * lock)
+{
+	return lock->Locked;
+}
+
+void perfCount(int counter)
+{
+}
+
+char * allocatePhysicalMemoryPage(void)
+{
+	return fsHostAllocatePage();
+}
+
+void freePhysicalMemoryPage(char * page)
+{
+	fsHostFreePage(page);
+}
+
+void cprintf(char * format, ...)
+{
+	char message[256];
+	va_list arguments;
+
+	va_start(arguments, format);
+	vsnprintf(message, sizeof(message), format, arguments);
+	va_end(arguments);
+	fsHostPrint(message);
+}
+
+void panic(char * message)
+{
+	fsHostPanic(message);
+	for (;;)
+	{
+	}
+}
+
+char * safestrcpy(char * s, const char * t, int n)
+{
+	char * os = s;
+
+	if (n <= 0)
+	{
+		return os;
+	}
+	while (--n > 0 && (*s++ = *t++) != 0)
+	{
+	}
+	*s = 0;
+	return os;
+}
+
+File * allocateFileStructure(void)
+{
+	static File files[NFILE];
+
+	for (int i = 0; i < NFILE; i++)
+	{
+		if (files[i].ReferenceCount == 0)
+		{
+			files[i].ReferenceCount = 1;
+			return &files[i];
+		}
+	}
+	return 0;
+}
+
+// Wrappers for fsbench.c
+
+void fsHostInitialise(void)
+{
+	diskBufferCacheInitialise();
+	vfsInitialise();
+	fsFatInitialise();
+}
+
+int fsHostMount(const char * path, unsigned device)
+{
+	return vfsMount(path, &fsFatOperations, device);
+}
+
+void * fsHostOpen(const char * path)
+{
+	return vfsOpen("/", path, 0);
+}
+
+int fsHostRead(void * file, char * buffer, int length)
+{
+	return vfsRead((File *)file, buffer, length);
+}
+
+void fsHostSeek(void * file, unsigned position)
+{
+	((File *)file)->Position = position;
+}
+
+int fsHostSize(void * file)
+{
+	Stat st;
+
+	if (vfsStat((File *)file, &st) < 0)
+	{
+		return -1;
+	}
+	return st.size;
+}
+
+// Close a file as fileClose does
+
+void fsHostClose(void * file)
+{
+	vfsClose((File *)file);
+	((File *)file)->ReferenceCount = 0;
+}
@@ -0,0 +1,25 @@
+// Interface between the two halves of fsbench.  fshost.c is built with the
+// kernel headers and fsbench.c with the host's, and the two cannot be mixed,
+// so only plain C types are used here.
+
+#ifndef FSHOST_H
+#define FSHOST_H
+
+// Provided by fshost.c, which wraps the kernel's VFS calls
+void	fsHostInitialise(void);
+int		fsHostMount(const char * path, unsigned device);
+void *	fsHostOpen(const char * path);
+int		fsHostRead(void * file, char * buffer, int length);
+void	fsHostSeek(void * file, unsigned position);
+int		fsHostSize(void * file);
+void	fsHostClose(void * file);
+
+// Provided by fsbench.c
+void	fsHostReadSector(unsigned device, unsigned sector, void * buffer);
+void	fsHostWriteSector(unsigned device, unsigned sector, const void * buffer);
+void	fsHostPrint(const char * message);
+void	fsHostPanic(const char * message);
+void *	fsHostAllocatePage(void);
+void	fsHostFreePage(void * page);
+
+#endif
@@ -0,0 +1,192 @@
+// Host benchmark of spin lock algorithms under contention.
+//
+// Runs one thread per host CPU (or the number given), each acquiring and
+// releasing the same lock as fast as it can for a second, and reports the
+// total acquisitions per second and how evenly they were shared between
+// the threads.  Three locks are compared:
+//
+//   tas     the xchg loop that spinlock.c used to use
+//   ttas    test-and-test-and-set with pause: only try the xchg when the lock looks free
+//   ticket  the ticket lock that spinlock.c uses now
+//
+// The locks are copies of the kernel's, since the kernel's need cli and sti.
+// Use no more threads than there are host CPUs.  The kernel holds spin locks
+// with interrupts off, so a holder is never preempted, but host threads are,
+// and a ticket lock then stalls every waiter queued behind the preempted one.
+//
+// Usage: lockbench [threads] [milliseconds]
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAXTHREADS	64
+
+typedef struct
+{
+	volatile uint32_t	Locked;
+	volatile uint16_t	Owner;
+	volatile uint16_t	Next;
+} __attribute__((aligned(64))) Lock;
+
+typedef struct
+{
+	const char *		Name;
+	void				(*Acquire)(Lock *);
+	void				(*Release)(Lock *);
+} Algorithm;
+
+typedef struct
+{
+	const Algorithm *	Algorithm;
+	uint64_t			Acquires;
+} __attribute__((aligned(64))) Thread;
+
+static Lock lock;
+static volatile uint64_t shared[8];		// Touched while the lock is held
+static volatile int started;
+static volatile int stopping;
+static int threadCount;
+
+static inline uint32_t atomicExchange(volatile uint32_t *addr, uint32_t newval)
+{
+	return __atomic_exchange_n(addr, newval, __ATOMIC_ACQUIRE);
+}
+
+static inline void cpuRelax(void)
+{
+	__builtin_ia32_pause();
+}
+
+static void tasAcquire(Lock * lk)
+{
+	while (atomicExchange(&lk->Locked, 1) != 0)
+	{
+	}
+}
+
+static void tasRelease(Lock * lk)
+{
+	__atomic_store_n(&lk->Locked, 0, __ATOMIC_RELEASE);
+}
+
+static void ttasAcquire(Lock * lk)
+{
+	while (atomicExchange(&lk->Locked, 1) != 0)
+	{
+		while (lk->Locked)
+		{
+			cpuRelax();
+		}
+	}
+}
+
+static void ticketAcquire(Lock * lk)
+{
+	uint16_t ticket = __atomic_fetch_add(&lk->Next, 1, __ATOMIC_ACQUIRE);
+
+	while (__atomic_load_n(&lk->Owner, __ATOMIC_ACQUIRE) != ticket)
+	{
+		cpuRelax();
+	}
+}
+
+static void ticketRelease(Lock * lk)
+{
+	__atomic_store_n(&lk->Owner, lk->Owner + 1, __ATOMIC_RELEASE);
+}
+
+static const Algorithm algorithms[] =
+{
+	{ "tas", tasAcquire, tasRelease },
+	{ "ttas", ttasAcquire, tasRelease },
+	{ "ticket", ticketAcquire, ticketRelease },
+};
+
+static void * threadMain(void * argument)
+{
+	Thread * thread = argument;
+	const Algorithm * algorithm = thread->Algorithm;
+	uint64_t acquires = 0;
+
+	__atomic_fetch_add(&started, 1, __ATOMIC_SEQ_CST);
+	while (started < threadCount)
+	{
+	}
+	while (!stopping)
+	{
+		algorithm->Acquire(&lock);
+		for (int i = 0; i < 8; i++)
+		{
+			shared[i]++;
+		}
+		algorithm->Release(&lock);
+		acquires++;
+	}
+	thread->Acquires = acquires;
+	return 0;
+}
+
+static void run(const Algorithm * algorithm, int milliseconds)
+{
+	static Thread threads[MAXTHREADS];
+	pthread_t handles[MAXTHREADS];
+	struct timespec period = { milliseconds / 1000, (milliseconds % 1000) * 1000000L };
+	uint64_t total = 0;
+	uint64_t fewest = UINT64_MAX;
+	uint64_t most = 0;
+	double sum = 0;
+	double sumOfSquares = 0;
+
+	started = 0;
+	stopping = 0;
+	for (int i = 0; i < threadCount; i++)
+	{
+		threads[i].Algorithm = algorithm;
+		pthread_create(&handles[i], 0, threadMain, &threads[i]);
+	}
+	while (started < threadCount)
+	{
+	}
+	nanosleep(&period, 0);
+	stopping = 1;
+	for (int i = 0; i < threadCount; i++)
+	{
+		pthread_join(handles[i], 0);
+		uint64_t acquires = threads[i].Acquires;
+		total += acquires;
+		fewest = acquires < fewest ? acquires : fewest;
+		most = acquires > most ? acquires : most;
+		sum += acquires;
+		sumOfSquares += (double)acquires * acquires;
+	}
+	// Jain's fairness index is 1 when every thread got the same share and 1/threads when one got it all
+	printf("  %-8s %12.0f acquires/s   fewest %10llu   most %10llu   fairness %.3f\n",
+		   algorithm->Name,
+		   total * 1000.0 / milliseconds,
+		   (unsigned long long)fewest,
+		   (unsigned long long)most,
+		   sumOfSquares > 0 ? sum * sum / (threadCount * sumOfSquares) : 1.0);
+}
+
+int main(int argc, char * argv[])
+{
+	int milliseconds = argc > 2 ? atoi(argv[2]) : 1000;
+
+	threadCount = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (threadCount < 1 || threadCount > MAXTHREADS || milliseconds < 1)
+	{
+		fprintf(stderr, "usage: lockbench [threads] [milliseconds]\n");
+		return 1;
+	}
+	printf("%d threads, %d ms each\n", threadCount, milliseconds);
+	for (int i = 0; i < (int)(sizeof(algorithms) / sizeof(algorithms[0])); i++)
+	{
+		run(&algorithms[i], milliseconds);
+	}
+	return 0;
+}
@@ -0,0 +1,179 @@
+// Compress the kernel image for the boot loader.
+//
+// This is a host program, run by the makefile.  It compresses a file into
+// a single LZ4 block, preceded by a 12 byte header:
+//
+//	Offset 0	Magic number (KERNEL_LZ4_MAGIC)
+//	Offset 4	Size of the uncompressed data
+//	Offset 8	Size of the compressed block
+//
+// The second stage of the boot loader (see lz4.asm) recognises the magic
+// number and decompresses the kernel straight to where it runs.  Fewer
+// sectors have to be read through the BIOS, which is much the slowest
+// part of booting.
+//
+// The compressor is a simple greedy one with a hash table of the last
+// position each 4 byte sequence was seen at.  It is not as tight as the
+// reference LZ4 compressor, but the output is a valid LZ4 block.
+//
+// Usage: lz4pack input output
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define KERNEL_LZ4_MAGIC	0x4B345A4C		// "LZ4K"
+
+#define MINMATCH			4
+#define LASTLITERALS		5				// The last 5 bytes are always literals
+#define MFLIMIT				12				// A match must start at least 12 bytes before the end
+#define MAXOFFSET			65535
+#define HASHBITS			16
+
+static uint32_t readLong(const uint8_t * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t hash(uint32_t sequence)
+{
+	return (sequence * 2654435761U) >> (32 - HASHBITS);
+}
+
+// Write a length of 15 or more as extra bytes after the token
+
+static uint8_t * writeLength(uint8_t * out, uint32_t length)
+{
+	length -= 15;
+	while (length >= 255)
+	{
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = (uint8_t)length;
+	return out;
+}
+
+// Write a sequence: a token, the literals, then the match (if there is one)
+
+static uint8_t * writeSequence(uint8_t * out, const uint8_t * literals, uint32_t literalLength, uint32_t offset, uint32_t matchLength)
+{
+	uint8_t * token = out++;
+
+	*token = (literalLength < 15 ? literalLength : 15) << 4;
+	if (literalLength >= 15)
+	{
+		out = writeLength(out, literalLength);
+	}
+	memcpy(out, literals, literalLength);
+	out += literalLength;
+	if (matchLength == 0)
+	{
+		return out;
+	}
+	*out++ = offset & 0xFF;
+	*out++ = offset >> 8;
+	matchLength -= MINMATCH;
+	*token |= matchLength < 15 ? matchLength : 15;
+	if (matchLength >= 15)
+	{
+		out = writeLength(out, matchLength);
+	}
+	return out;
+}
+
+// Compress size bytes from in to out, returning the size of the
+// compressed block.  out must have room for compressBound(size) bytes.
+
+static uint32_t compress(const uint8_t * in, uint32_t size, uint8_t * out)
+{
+	static uint32_t table[1 << HASHBITS];
+	const uint8_t * anchor = in;
+	const uint8_t * end = in + size;
+	uint8_t * start = out;
+	uint32_t position = 0;
+
+	memset(table, 0xFF, sizeof(table));
+	if (size > MFLIMIT)
+	{
+		while (position + MFLIMIT <= size)
+		{
+			uint32_t sequence = readLong(in + position);
+			uint32_t h = hash(sequence);
+			uint32_t candidate = table[h];
+			table[h] = position;
+			if (candidate == 0xFFFFFFFF || position - candidate > MAXOFFSET || readLong(in + candidate) != sequence)
+			{
+				position++;
+				continue;
+			}
+			// Extend the match, stopping short of the bytes that must be literals
+			uint32_t length = MINMATCH;
+			while (position + length < size - LASTLITERALS && in[candidate + length] == in[position + length])
+			{
+				length++;
+			}
+			out = writeSequence(out, anchor, in + position - anchor, position - candidate, length);
+			position += length;
+			anchor = in + position;
+		}
+	}
+	out = writeSequence(out, anchor, end - anchor, 0, 0);
+	return out - start;
+}
+
+static uint32_t compressBound(uint32_t size)
+{
+	return size + size / 255 + 16;
+}
+
+int main(int argc, char ** argv)
+{
+	FILE * file;
+	uint8_t * in;
+	uint8_t * out;
+	long size;
+
+	if (argc != 3)
+	{
+		fprintf(stderr, "Usage: lz4pack input output\n");
+		return 1;
+	}
+	file = fopen(argv[1], "rb");
+	if (file == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	fseek(file, 0, SEEK_END);
+	size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	in = malloc(size + 1);
+	out = malloc(compressBound(size) + 12);
+	if (in == NULL || out == NULL || fread(in, 1, size, file) != (size_t)size)
+	{
+		fprintf(stderr, "lz4pack: cannot read %s\n", argv[1]);
+		return 1;
+	}
+	fclose(file);
+
+	uint32_t compressedSize = compress(in, size, out + 12);
+	uint32_t header[3] = { KERNEL_LZ4_MAGIC, (uint32_t)size, compressedSize };
+	for (int i = 0; i < 3; i++)
+	{
+		out[i * 4] = header[i] & 0xFF;
+		out[i * 4 + 1] = (header[i] >> 8) & 0xFF;
+		out[i * 4 + 2] = (header[i] >> 16) & 0xFF;
+		out[i * 4 + 3] = header[i] >> 24;
+	}
+
+	file = fopen(argv[2], "wb");
+	if (file == NULL || fwrite(out, 1, compressedSize + 12, file) != compressedSize + 12 || fclose(file) != 0)
+	{
+		perror(argv[2]);
+		return 1;
+	}
+	printf("lz4pack: %s %ld bytes, %s %u bytes\n", argv[1], size, argv[2], compressedSize + 12);
+	return 0;
+}
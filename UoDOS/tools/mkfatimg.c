@@ -0,0 +1,826 @@
+// Build or update a FAT disk image.
+//
+// This is a host program, run by the makefile in place of mounting the image
+// with imdisk and copying files with "cmd /c copy".  It works directly on the
+// image file, so it runs anywhere there is a C compiler.
+//
+// Usage: mkfatimg [options] image [source=path ...]
+//
+//	-b file		Boot sector.  Its BIOS Parameter Block defines the format of the image.
+//	-r file		Written to the reserved sectors following the boot sector (boot2.bin).
+//	-f type		Format as fat12, fat16 or fat32 with a generated boot sector.
+//	-s sectors	Size of the image when formatting with -f (default 20160, i.e. about 10MB).
+//	-c sectors	Sectors per cluster when formatting with -f (default: the smallest that fits).
+//
+// Each source=path copies the host file source to path in the image (for example
+// "init.exe=/usrbin/init.exe").  Missing directories are created.  Names must be
+// valid 8.3 names and are stored in upper case.
+//
+// If the image already exists and has the same format as the one asked for, it
+// is updated in place: files whose contents have not changed are left alone, and
+// only the sectors that have changed are written back.  Otherwise a new image is
+// made.  All timestamps are set from SOURCE_DATE_EPOCH (or 1 January 1980 if that
+// is not set), and clusters are always allocated first fit, so the same inputs
+// always give the same image.
+//
+// The on-disk structures are little-endian, like the host this runs on.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "../bpb.h"
+
+#define ATTRIB_DIRECTORY	0x10
+#define ATTRIB_ARCHIVE		0x20
+#define ATTRIB_LONGNAME		0x0F
+
+#define ENTRY_FREE			0xE5
+#define ENTRY_END			0x00
+
+// Same layout as DirectoryEntry in fs.h
+
+typedef struct _FatDirectoryEntry
+{
+	uint8_t   Name[11];
+	uint8_t   Attrib;
+	uint8_t   Reserved;
+	uint8_t   TimeCreatedMs;
+	uint16_t  TimeCreated;
+	uint16_t  DateCreated;
+	uint16_t  DateLastAccessed;
+	uint16_t  FirstClusterHiBytes;
+	uint16_t  LastModTime;
+	uint16_t  LastModDate;
+	uint16_t  FirstCluster;
+	uint32_t  FileSize;
+} __attribute__((packed)) FatDirectoryEntry;
+
+typedef struct _Image
+{
+	uint8_t *	Data;
+	uint8_t *	Dirty;				// One flag per sector
+	uint32_t	NumSectors;
+	uint32_t	BytesPerSector;
+	uint32_t	FatType;
+	uint32_t	NumberOfFats;
+	uint32_t	FatOffset;			// First sector of the first FAT
+	uint32_t	FatSize;			// Sectors per FAT
+	uint32_t	RootOffset;			// FAT12 and FAT16 only
+	uint32_t	NumRootEntries;
+	uint32_t	RootCluster;		// FAT32 only
+	uint32_t	DataOffset;			// First sector of cluster 2
+	uint32_t	SectorsPerCluster;
+	uint32_t	ClusterSize;
+	uint32_t	ClusterCount;
+	uint32_t	NextFree;			// Where to start looking for a free cluster
+	uint16_t	Date;
+	uint16_t	Time;
+} Image;
+
+static void fail(const char * message, const char * detail)
+{
+	fprintf(stderr, "mkfatimg: %s%s%s\n", message, detail ? ": " : "", detail ? detail : "");
+	exit(1);
+}
+
+static uint8_t * readFile(const char * filename, uint32_t * size)
+{
+	FILE * file = fopen(filename, "rb");
+	uint8_t * data;
+	long length;
+
+	if (file == NULL)
+	{
+		fail("cannot open", filename);
+	}
+	fseek(file, 0, SEEK_END);
+	length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	data = malloc(length + 1);
+	if (data == NULL || fread(data, 1, length, file) != (size_t)length)
+	{
+		fail("cannot read", filename);
+	}
+	fclose(file);
+	*size = length;
+	return data;
+}
+
+// Mark the sectors covering length bytes at p as needing to be written
+
+static void markDirty(Image * image, void * p, uint32_t length)
+{
+	uint32_t offset = (uint8_t *)p - image->Data;
+
+	for (uint32_t sector = offset / image->BytesPerSector; sector <= (offset + length - 1) / image->BytesPerSector; sector++)
+	{
+		image->Dirty[sector] = 1;
+	}
+}
+
+// Copy data into the image, marking it dirty only if it changes
+
+static void imageWrite(Image * image, uint8_t * destination, const void * source, uint32_t length)
+{
+	if (memcmp(destination, source, length) != 0)
+	{
+		memcpy(destination, source, length);
+		markDirty(image, destination, length);
+	}
+}
+
+static uint8_t * sectorPointer(Image * image, uint32_t sector)
+{
+	return image->Data + sector * image->BytesPerSector;
+}
+
+static uint8_t * clusterPointer(Image * image, uint32_t cluster)
+{
+	return sectorPointer(image, image->DataOffset + (cluster - 2) * image->SectorsPerCluster);
+}
+
+static uint32_t endOfChain(Image * image)
+{
+	return image->FatType == 12 ? 0xFFF : image->FatType == 16 ? 0xFFFF : 0x0FFFFFFF;
+}
+
+static uint32_t fatGet(Image * image, uint32_t cluster)
+{
+	uint8_t * fat = sectorPointer(image, image->FatOffset);
+
+	switch (image->FatType)
+	{
+		case 12:
+		{
+			uint16_t value = fat[cluster + cluster / 2] | (fat[cluster + cluster / 2 + 1] << 8);
+			return cluster & 1 ? value >> 4 : value & 0xFFF;
+		}
+
+		case 16:
+			return ((uint16_t *)fat)[cluster];
+
+		default:
+			return ((uint32_t *)fat)[cluster] & 0x0FFFFFFF;
+	}
+}
+
+// Set a FAT entry in every copy of the FAT
+
+static void fatSet(Image * image, uint32_t cluster, uint32_t value)
+{
+	for (uint32_t copy = 0; copy < image->NumberOfFats; copy++)
+	{
+		uint8_t * fat = sectorPointer(image, image->FatOffset + copy * image->FatSize);
+		switch (image->FatType)
+		{
+			case 12:
+			{
+				uint8_t * p = fat + cluster + cluster / 2;
+				uint16_t old = p[0] | (p[1] << 8);
+				uint16_t new = cluster & 1 ? (old & 0x000F) | (value << 4) : (old & 0xF000) | (value & 0xFFF);
+				uint8_t bytes[2] = { new & 0xFF, new >> 8 };
+				imageWrite(image, p, bytes, 2);
+				break;
+			}
+
+			case 16:
+			{
+				uint16_t new = value;
+				imageWrite(image, fat + cluster * 2, &new, 2);
+				break;
+			}
+
+			default:
+			{
+				uint32_t new = (((uint32_t *)fat)[cluster] & 0xF0000000) | (value & 0x0FFFFFFF);
+				imageWrite(image, fat + cluster * 4, &new, 4);
+				break;
+			}
+		}
+	}
+}
+
+static int isEndOfChain(Image * image, uint32_t cluster)
+{
+	return cluster < 2 || cluster >= image->ClusterCount + 2;
+}
+
+static void freeChain(Image * image, uint32_t cluster)
+{
+	while (!isEndOfChain(image, cluster))
+	{
+		uint32_t next = fatGet(image, cluster);
+		fatSet(image, cluster, 0);
+		if (cluster < image->NextFree)
+		{
+			image->NextFree = cluster;
+		}
+		cluster = next;
+	}
+}
+
+// Allocate a free cluster, zero it and link it after previous (if not 0)
+
+static uint32_t allocateCluster(Image * image, uint32_t previous)
+{
+	for (uint32_t cluster = image->NextFree; cluster < image->ClusterCount + 2; cluster++)
+	{
+		if (fatGet(image, cluster) == 0)
+		{
+			fatSet(image, cluster, endOfChain(image));
+			if (previous)
+			{
+				fatSet(image, previous, cluster);
+			}
+			uint8_t * data = clusterPointer(image, cluster);
+			memset(data, 0, image->ClusterSize);
+			markDirty(image, data, image->ClusterSize);
+			image->NextFree = cluster + 1;
+			return cluster;
+		}
+	}
+	fail("image is full", NULL);
+	return 0;
+}
+
+static uint32_t entryCluster(FatDirectoryEntry * entry)
+{
+	return entry->FirstCluster | (entry->FirstClusterHiBytes << 16);
+}
+
+static void setEntryCluster(Image * image, FatDirectoryEntry * entry, uint32_t cluster)
+{
+	entry->FirstCluster = cluster & 0xFFFF;
+	entry->FirstClusterHiBytes = image->FatType == 32 ? cluster >> 16 : 0;
+}
+
+// Return the index'th entry of a directory, or NULL past the end.  directory
+// is the directory's first cluster, with 0 meaning the root directory.
+
+static FatDirectoryEntry * directoryEntry(Image * image, uint32_t directory, uint32_t index)
+{
+	uint32_t perCluster = image->ClusterSize / sizeof(FatDirectoryEntry);
+
+	if (directory == 0)
+	{
+		if (image->FatType != 32)
+		{
+			return index < image->NumRootEntries ? (FatDirectoryEntry *)sectorPointer(image, image->RootOffset) + index : NULL;
+		}
+		directory = image->RootCluster;
+	}
+	while (index >= perCluster)
+	{
+		directory = fatGet(image, directory);
+		if (isEndOfChain(image, directory))
+		{
+			return NULL;
+		}
+		index -= perCluster;
+	}
+	return (FatDirectoryEntry *)clusterPointer(image, directory) + index;
+}
+
+static FatDirectoryEntry * directoryFind(Image * image, uint32_t directory, const uint8_t * name)
+{
+	FatDirectoryEntry * entry;
+
+	for (uint32_t index = 0; (entry = directoryEntry(image, directory, index)) != NULL && entry->Name[0] != ENTRY_END; index++)
+	{
+		if (entry->Name[0] != ENTRY_FREE && entry->Attrib != ATTRIB_LONGNAME && memcmp(entry->Name, name, 11) == 0)
+		{
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+// Find a free entry in a directory, extending it if it is full
+
+static FatDirectoryEntry * directoryNewEntry(Image * image, uint32_t directory)
+{
+	FatDirectoryEntry * entry;
+	uint32_t index;
+
+	for (index = 0; (entry = directoryEntry(image, directory, index)) != NULL; index++)
+	{
+		if (entry->Name[0] == ENTRY_FREE || entry->Name[0] == ENTRY_END)
+		{
+			return entry;
+		}
+	}
+	if (directory == 0 && image->FatType != 32)
+	{
+		fail("root directory is full", NULL);
+	}
+	uint32_t last = directory == 0 ? image->RootCluster : directory;
+	while (!isEndOfChain(image, fatGet(image, last)))
+	{
+		last = fatGet(image, last);
+	}
+	allocateCluster(image, last);
+	return directoryEntry(image, directory, index);
+}
+
+static void initialiseEntry(Image * image, FatDirectoryEntry * entry, const uint8_t * name, uint8_t attrib)
+{
+	memset(entry, 0, sizeof(FatDirectoryEntry));
+	memcpy(entry->Name, name, 11);
+	entry->Attrib = attrib;
+	entry->TimeCreated = entry->LastModTime = image->Time;
+	entry->DateCreated = entry->DateLastAccessed = entry->LastModDate = image->Date;
+	markDirty(image, entry, sizeof(FatDirectoryEntry));
+}
+
+// Convert a name to the 11 character form used in directory entries
+
+static void makeName83(const char * name, uint32_t length, uint8_t * name83)
+{
+	uint32_t i = 0;
+	uint32_t j = 0;
+
+	memset(name83, ' ', 11);
+	while (i < length && name[i] != '.' && j < 8)
+	{
+		name83[j++] = toupper((unsigned char)name[i++]);
+	}
+	if (i < length && name[i] == '.')
+	{
+		i++;
+		for (j = 8; i < length && name[i] != '.' && j < 11; )
+		{
+			name83[j++] = toupper((unsigned char)name[i++]);
+		}
+	}
+	if (i != length || name83[0] == ' ')
+	{
+		fail("not a valid 8.3 name", name);
+	}
+	for (j = 0; j < 11; j++)
+	{
+		if (name83[j] < ' ' || strchr("\"*+,/:;<=>?[\\]|", name83[j]) != NULL)
+		{
+			fail("not a valid 8.3 name", name);
+		}
+	}
+}
+
+static uint32_t makeDirectory(Image * image, uint32_t parent, const uint8_t * name)
+{
+	FatDirectoryEntry * entry = directoryNewEntry(image, parent);
+	uint32_t cluster = allocateCluster(image, 0);
+
+	initialiseEntry(image, entry, name, ATTRIB_DIRECTORY);
+	setEntryCluster(image, entry, cluster);
+	FatDirectoryEntry * dot = (FatDirectoryEntry *)clusterPointer(image, cluster);
+	initialiseEntry(image, &dot[0], (const uint8_t *)".          ", ATTRIB_DIRECTORY);
+	setEntryCluster(image, &dot[0], cluster);
+	initialiseEntry(image, &dot[1], (const uint8_t *)"..         ", ATTRIB_DIRECTORY);
+	setEntryCluster(image, &dot[1], parent);
+	return cluster;
+}
+
+// Do the contents of a file in the image match data?
+
+static int sameContents(Image * image, FatDirectoryEntry * entry, const uint8_t * data, uint32_t size)
+{
+	uint32_t cluster = entryCluster(entry);
+
+	if (entry->FileSize != size)
+	{
+		return 0;
+	}
+	for (uint32_t position = 0; position < size; position += image->ClusterSize)
+	{
+		uint32_t length = size - position < image->ClusterSize ? size - position : image->ClusterSize;
+		if (isEndOfChain(image, cluster) || memcmp(clusterPointer(image, cluster), data + position, length) != 0)
+		{
+			return 0;
+		}
+		cluster = fatGet(image, cluster);
+	}
+	return 1;
+}
+
+// Copy a host file into the image.  Returns 1 if the image changed.
+
+static int addFile(Image * image, const char * source, const char * path)
+{
+	uint32_t directory = 0;
+	uint8_t name83[11];
+	FatDirectoryEntry * entry;
+	uint32_t size;
+	uint8_t * data = readFile(source, &size);
+
+	// Find (or make) the directory the file goes in
+	while (*path == '/')
+	{
+		path++;
+	}
+	const char * separator;
+	while ((separator = strchr(path, '/')) != NULL)
+	{
+		makeName83(path, separator - path, name83);
+		entry = directoryFind(image, directory, name83);
+		if (entry == NULL)
+		{
+			directory = makeDirectory(image, directory, name83);
+		}
+		else if (entry->Attrib & ATTRIB_DIRECTORY)
+		{
+			directory = entryCluster(entry);
+		}
+		else
+		{
+			fail("not a directory", path);
+		}
+		path = separator + 1;
+	}
+	makeName83(path, strlen(path), name83);
+	entry = directoryFind(image, directory, name83);
+	if (entry != NULL && (entry->Attrib & ATTRIB_DIRECTORY))
+	{
+		fail("is a directory", path);
+	}
+	if (entry != NULL && sameContents(image, entry, data, size))
+	{
+		free(data);
+		return 0;
+	}
+	if (entry == NULL)
+	{
+		entry = directoryNewEntry(image, directory);
+		initialiseEntry(image, entry, name83, ATTRIB_ARCHIVE);
+	}
+	else
+	{
+		freeChain(image, entryCluster(entry));
+	}
+
+	uint32_t first = 0;
+	uint32_t cluster = 0;
+	for (uint32_t position = 0; position < size; position += image->ClusterSize)
+	{
+		uint32_t length = size - position < image->ClusterSize ? size - position : image->ClusterSize;
+		cluster = allocateCluster(image, cluster);
+		if (first == 0)
+		{
+			first = cluster;
+		}
+		memcpy(clusterPointer(image, cluster), data + position, length);
+	}
+	setEntryCluster(image, entry, first);
+	entry->FileSize = size;
+	entry->LastModTime = image->Time;
+	entry->LastModDate = image->Date;
+	markDirty(image, entry, sizeof(FatDirectoryEntry));
+	free(data);
+	return 1;
+}
+
+// Work out the layout of the image from the boot sector.  This must agree
+// with fsFatMount in fs.c.
+
+static void imageLayout(Image * image, BootSector * bootSector)
+{
+	BIOSParameterBlock * bpb = &bootSector->Bpb;
+
+	image->BytesPerSector = bpb->BytesPerSector;
+	image->NumSectors = bpb->NumSectors ? bpb->NumSectors : bpb->LongSectors;
+	image->NumberOfFats = bpb->NumberOfFats;
+	image->FatOffset = bpb->ReservedSectors;
+	image->FatSize = bpb->SectorsPerFat ? bpb->SectorsPerFat : bootSector->BpbExt.SectorsPerFat32;
+	image->NumRootEntries = bpb->NumDirEntries;
+	image->RootOffset = image->FatOffset + image->NumberOfFats * image->FatSize;
+	image->DataOffset = image->RootOffset + (image->NumRootEntries * sizeof(FatDirectoryEntry) + image->BytesPerSector - 1) / image->BytesPerSector;
+	image->SectorsPerCluster = bpb->SectorsPerCluster;
+	if (image->BytesPerSector < 512 || image->SectorsPerCluster == 0 || image->NumberOfFats == 0 || image->DataOffset >= image->NumSectors)
+	{
+		fail("boot sector does not describe a FAT file system", NULL);
+	}
+	image->ClusterSize = image->SectorsPerCluster * image->BytesPerSector;
+	image->ClusterCount = (image->NumSectors - image->DataOffset) / image->SectorsPerCluster;
+	image->FatType = image->ClusterCount < 4085 ? 12 : image->ClusterCount < 65525 ? 16 : 32;
+	image->RootCluster = image->FatType == 32 ? bootSector->BpbExt.RootCluster : 0;
+	image->NextFree = 2;
+}
+
+// Generate a boot sector for an image of the given type and size.  The
+// boot code just says that the disk is not bootable.
+
+static void makeBootSector(BootSector * bootSector, uint32_t fatType, uint32_t numSectors, uint32_t sectorsPerCluster)
+{
+	static const uint8_t bootCode[] =
+	{
+		0xFA, 0x31, 0xC0, 0x8E, 0xD8, 0xBE, 0x00, 0x00,	// cli; xor ax, ax; mov ds, ax; mov si, message
+		0xAC, 0x08, 0xC0, 0x74, 0x06, 0xB4, 0x0E, 0xCD,	// lodsb; or al, al; jz halt; mov ah, 0Eh; int 10h
+		0x10, 0xEB, 0xF5, 0xF4, 0xEB, 0xFD				// jmp lodsb; halt: hlt; jmp halt
+	};
+	static const char message[] = "Not a bootable disk\r\n";
+	BIOSParameterBlock * bpb = &bootSector->Bpb;
+	uint8_t * sector = (uint8_t *)bootSector;
+	uint32_t bootOffset = fatType == 32 ? 90 : 62;
+	uint32_t extendedOffset = fatType == 32 ? 64 : 36;
+	uint32_t rootSectors = fatType == 32 ? 0 : 32;
+	uint32_t fatSize = 1;
+
+	memset(bootSector, 0, sizeof(BootSector));
+	sector[0] = 0xEB;
+	sector[1] = bootOffset - 2;
+	sector[2] = 0x90;
+	memcpy(bpb->OEMName, "UODOS   ", 8);
+	bpb->BytesPerSector = 512;
+	bpb->ReservedSectors = fatType == 32 ? 32 : 1;
+	bpb->NumberOfFats = 2;
+	bpb->NumDirEntries = rootSectors * 512 / sizeof(FatDirectoryEntry);
+	bpb->Media = 0xF8;
+	bpb->SectorsPerTrack = 63;
+	bpb->HeadsPerCyl = 16;
+
+	// Choose the smallest cluster size that keeps the cluster count in range for
+	// the type, then find the FAT size by iterating until it settles
+	uint32_t limit = fatType == 12 ? 4084 : fatType == 16 ? 65524 : 0x0FFFFFF5;
+	uint32_t clusters = 0;
+	for (uint32_t size = sectorsPerCluster ? sectorsPerCluster : 1; size <= 128; size *= 2)
+	{
+		for (int i = 0; i < 8; i++)
+		{
+			clusters = (numSectors - bpb->ReservedSectors - 2 * fatSize - rootSectors) / size;
+			fatSize = ((clusters + 2) * (fatType == 12 ? 3 : fatType == 16 ? 4 : 8) / 2 + 511) / 512;
+		}
+		bpb->SectorsPerCluster = size;
+		if (clusters <= limit || sectorsPerCluster)
+		{
+			break;
+		}
+	}
+	uint32_t minimum = fatType == 12 ? 1 : fatType == 16 ? 4085 : 65525;
+	if (clusters < minimum || clusters > limit)
+	{
+		fail("cannot make a file system of that type and size", NULL);
+	}
+	if (numSectors < 65536 && fatType != 32)
+	{
+		bpb->NumSectors = numSectors;
+	}
+	else
+	{
+		bpb->LongSectors = numSectors;
+	}
+	if (fatType == 32)
+	{
+		bootSector->BpbExt.SectorsPerFat32 = fatSize;
+		bootSector->BpbExt.RootCluster = 2;
+		bootSector->BpbExt.InfoCluster = 0xFFFF;		// No FSInfo sector
+	}
+	else
+	{
+		bpb->SectorsPerFat = fatSize;
+	}
+	sector[extendedOffset] = 0x80;						// Drive number
+	sector[extendedOffset + 2] = 0x29;					// Extended boot signature
+	memcpy(sector + extendedOffset + 3, "\x48\x1B\x5B\x63", 4);
+	memcpy(sector + extendedOffset + 7, "NO NAME    ", 11);
+	memcpy(sector + extendedOffset + 18, fatType == 12 ? "FAT12   " : fatType == 16 ? "FAT16   " : "FAT32   ", 8);
+	memcpy(sector + bootOffset, bootCode, sizeof(bootCode));
+	sector[bootOffset + 6] = (0x7C00 + bootOffset + sizeof(bootCode)) & 0xFF;
+	sector[bootOffset + 7] = (0x7C00 + bootOffset + sizeof(bootCode)) >> 8;
+	memcpy(sector + bootOffset + sizeof(bootCode), message, sizeof(message));
+	sector[510] = 0x55;
+	sector[511] = 0xAA;
+}
+
+// Make an empty file system described by the boot sector
+
+static void formatImage(Image * image, BootSector * bootSector)
+{
+	imageLayout(image, bootSector);
+	image->Data = calloc(image->NumSectors, image->BytesPerSector);
+	image->Dirty = malloc(image->NumSectors);
+	if (image->Data == NULL || image->Dirty == NULL)
+	{
+		fail("out of memory", NULL);
+	}
+	memset(image->Dirty, 1, image->NumSectors);
+	memcpy(image->Data, bootSector, sizeof(BootSector));
+	fatSet(image, 0, (endOfChain(image) & ~0xFF) | bootSector->Bpb.Media);
+	fatSet(image, 1, endOfChain(image));
+	if (image->FatType == 32)
+	{
+		image->RootCluster = allocateCluster(image, 0);
+	}
+}
+
+// Load an existing image if it has the same layout as the boot sector
+
+static int loadImage(Image * image, const char * filename, BootSector * bootSector)
+{
+	FILE * file = fopen(filename, "rb");
+	BootSector existing;
+	uint32_t length = bootSector->Bpb.SectorsPerFat ? sizeof(BIOSParameterBlock) : sizeof(BIOSParameterBlock) + sizeof(BIOSParameterBlockExt);
+
+	if (file == NULL)
+	{
+		return 0;
+	}
+	if (fread(&existing, sizeof(BootSector), 1, file) != 1 || memcmp(&existing.Bpb, &bootSector->Bpb, length) != 0)
+	{
+		fclose(file);
+		return 0;
+	}
+	imageLayout(image, &existing);
+	image->Data = malloc(image->NumSectors * image->BytesPerSector);
+	image->Dirty = calloc(image->NumSectors, 1);
+	if (image->Data == NULL || image->Dirty == NULL)
+	{
+		fail("out of memory", NULL);
+	}
+	fseek(file, 0, SEEK_SET);
+	if (fread(image->Data, image->BytesPerSector, image->NumSectors, file) != image->NumSectors)
+	{
+		fclose(file);
+		free(image->Data);
+		free(image->Dirty);
+		return 0;
+	}
+	fclose(file);
+	return 1;
+}
+
+// Write the sectors that have changed back to the image.  Returns the
+// number of sectors written.
+
+static uint32_t saveImage(Image * image, const char * filename, int created)
+{
+	FILE * file = fopen(filename, created ? "wb" : "r+b");
+	uint32_t written = 0;
+
+	if (file == NULL)
+	{
+		fail("cannot write", filename);
+	}
+	for (uint32_t sector = 0; sector < image->NumSectors; )
+	{
+		if (!image->Dirty[sector])
+		{
+			sector++;
+			continue;
+		}
+		uint32_t count = 1;
+		while (sector + count < image->NumSectors && image->Dirty[sector + count])
+		{
+			count++;
+		}
+		if (fseek(file, (long)sector * image->BytesPerSector, SEEK_SET) != 0 ||
+			fwrite(sectorPointer(image, sector), image->BytesPerSector, count, file) != count)
+		{
+			fail("cannot write", filename);
+		}
+		written += count;
+		sector += count;
+	}
+	if (fclose(file) != 0)
+	{
+		fail("cannot write", filename);
+	}
+	return written;
+}
+
+static void setTimestamp(Image * image)
+{
+	const char * epoch = getenv("SOURCE_DATE_EPOCH");
+	time_t seconds = epoch ? (time_t)strtoll(epoch, NULL, 10) : 0;
+	struct tm * t = gmtime(&seconds);
+
+	if (epoch == NULL || t == NULL || t->tm_year < 80)
+	{
+		image->Date = (1 << 5) | 1;						// 1 January 1980
+		image->Time = 0;
+		return;
+	}
+	image->Date = ((t->tm_year - 80) << 9) | ((t->tm_mon + 1) << 5) | t->tm_mday;
+	image->Time = (t->tm_hour << 11) | (t->tm_min << 5) | (t->tm_sec / 2);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: mkfatimg [-b bootsector] [-r reserved] [-f fat12|fat16|fat32] [-s sectors] [-c sectorspercluster] image [source=path ...]\n");
+	exit(1);
+}
+
+int main(int argc, char ** argv)
+{
+	const char * bootFilename = NULL;
+	const char * reservedFilename = NULL;
+	uint32_t fatType = 0;
+	uint32_t numSectors = 20160;
+	uint32_t sectorsPerCluster = 0;
+	BootSector bootSector;
+	Image image;
+	int argument;
+
+	memset(&image, 0, sizeof(Image));
+	for (argument = 1; argument < argc && argv[argument][0] == '-'; argument++)
+	{
+		const char * value = argument + 1 < argc ? argv[argument + 1] : NULL;
+		if (value == NULL || argv[argument][2] != 0)
+		{
+			usage();
+		}
+		switch (argv[argument++][1])
+		{
+			case 'b':
+				bootFilename = value;
+				break;
+
+			case 'r':
+				reservedFilename = value;
+				break;
+
+			case 'f':
+				fatType = strcmp(value, "fat12") == 0 ? 12 : strcmp(value, "fat16") == 0 ? 16 : strcmp(value, "fat32") == 0 ? 32 : 0;
+				if (fatType == 0)
+				{
+					usage();
+				}
+				break;
+
+			case 's':
+				numSectors = strtoul(value, NULL, 0);
+				break;
+
+			case 'c':
+				sectorsPerCluster = strtoul(value, NULL, 0);
+				break;
+
+			default:
+				usage();
+		}
+	}
+	if (argument >= argc || (bootFilename == NULL) == (fatType == 0))
+	{
+		usage();
+	}
+	const char * imageFilename = argv[argument++];
+	setTimestamp(&image);
+
+	if (bootFilename)
+	{
+		uint32_t size;
+		uint8_t * data = readFile(bootFilename, &size);
+		if (size != sizeof(BootSector))
+		{
+			fail("boot sector must be 512 bytes", bootFilename);
+		}
+		memcpy(&bootSector, data, sizeof(BootSector));
+		free(data);
+	}
+	else
+	{
+		makeBootSector(&bootSector, fatType, numSectors, sectorsPerCluster);
+	}
+	int created = !loadImage(&image, imageFilename, &bootSector);
+	if (created)
+	{
+		formatImage(&image, &bootSector);
+	}
+	imageWrite(&image, image.Data, &bootSector, sizeof(BootSector));
+	if (reservedFilename)
+	{
+		uint32_t size;
+		uint8_t * data = readFile(reservedFilename, &size);
+		if (size > (image.FatOffset - 1) * image.BytesPerSector)
+		{
+			fail("too big for the reserved sectors", reservedFilename);
+		}
+		imageWrite(&image, sectorPointer(&image, 1), data, size);
+		free(data);
+	}
+
+	int updated = 0;
+	int unchanged = 0;
+	for (; argument < argc; argument++)
+	{
+		char * separator = strchr(argv[argument], '=');
+		if (separator == NULL)
+		{
+			usage();
+		}
+		*separator = 0;
+		if (addFile(&image, argv[argument], separator + 1))
+		{
+			updated++;
+		}
+		else
+		{
+			unchanged++;
+		}
+	}
+	uint32_t written = saveImage(&image, imageFilename, created);
+	printf("mkfatimg: %s %s (FAT%u), %d files updated, %d unchanged, %u sectors written\n",
+		   imageFilename, created ? "created" : "updated", image.FatType, updated, unchanged, written);
+	return 0;
+}
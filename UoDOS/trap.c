@@ -11,8 +11,6 @@
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint32_t vectors[];  // in vectors.S: array of 256 entry pointers
-Spinlock tickslock;
-uint32_t ticks;
 
 void trapVectorsInitialise(void)
 {
@@ -23,7 +21,6 @@ void trapVectorsInitialise(void)
 		SETGATE(idt[i], 0, SEG_KCODE << 3, vectors[i], 0);
 	}
 	SETGATE(idt[T_SYSCALL], 1, SEG_KCODE << 3, vectors[T_SYSCALL], DPL_USER);
-	spinlockInitialise(&tickslock, "time");
 }
 
 void interruptDescriptorTableInitialise(void)
@@ -51,13 +48,7 @@ void trap(struct Trapframe *tf)
 	switch (tf->trapno) 
 	{
 		case T_IRQ0 + IRQ_TIMER:
-			if (myCpu() == 0) 
-			{
-				spinlockAcquire(&tickslock);
-				ticks++;
-				wakeup(&ticks);
-				spinlockRelease(&tickslock);
-			}
+			timerInterrupt();
 			localApicEndOfInterrupt();
 			break;
 
@@ -66,6 +57,16 @@ void trap(struct Trapframe *tf)
 			localApicEndOfInterrupt();
 			break;
 
+		case T_IRQ0 + IRQ_WAKEUP:
+			// Only here to end the halt in timerIdle, so the scheduler looks again.
+			localApicEndOfInterrupt();
+			break;
+
+		case T_IRQ0 + IRQ_TLBFLUSH:
+			tlbFlushInterrupt();
+			localApicEndOfInterrupt();
+			break;
+
 		case T_IRQ0 + IRQ_IDE + 1:
 			// Bochs generates spurious IDE1 interrupts.
 			break;
@@ -34,5 +34,7 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKEUP      20      // IPI that wakes an idle CPU
+#define IRQ_TLBFLUSH    21      // IPI that asks a CPU to flush its TLB
 #define IRQ_SPURIOUS    31
 
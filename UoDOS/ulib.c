@@ -3,6 +3,7 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "futex.h"
 
 // This is a dummy __main.  For some reason, gcc puts in a call to 
 // __main from main, so we just include a dummy.
@@ -117,3 +118,92 @@ void* memmove(void *vdst, void *vsrc, int n)
 	}
 	return vdst;
 }
+
+// Threads.
+//
+// A thread is a process made by clone that shares its creator's memory and
+// open files.  Each one gets a stack from malloc, starts in threadStart and
+// exits when its function returns.  Any thread can wait for another to
+// finish with threadJoin.
+
+#define THREADSTACKSIZE	8192
+
+static void threadStart(void *argument)
+{
+	Thread *thread = argument;
+
+	thread->Result = thread->Function(thread->Argument);
+	exit();
+}
+
+int threadCreate(Thread *thread, void* (*function)(void*), void *argument)
+{
+	thread->Function = function;
+	thread->Argument = argument;
+	thread->Result = 0;
+	thread->Stack = malloc(THREADSTACKSIZE);
+	if (thread->Stack == 0)
+	{
+		return -1;
+	}
+	thread->Id = clone(threadStart, thread, (char*)thread->Stack + THREADSTACKSIZE);
+	if (thread->Id < 0)
+	{
+		free(thread->Stack);
+		return -1;
+	}
+	return 0;
+}
+
+int threadJoin(Thread *thread, void **result)
+{
+	if (join(thread->Id) < 0)
+	{
+		return -1;
+	}
+	free(thread->Stack);
+	if (result)
+	{
+		*result = thread->Result;
+	}
+	return 0;
+}
+
+// Mutexes, from Ulrich Drepper's "Futexes Are Tricky".  Locking and
+// unlocking take one atomic instruction when there is no contention.  A
+// thread that finds the mutex locked marks it as having waiters (2) and
+// sleeps in the kernel, and unlocking only calls the kernel to wake a
+// waiter when the mutex was so marked.
+
+void mutexInitialise(Mutex *mutex)
+{
+	mutex->State = 0;
+}
+
+void mutexLock(Mutex *mutex)
+{
+	int state = __sync_val_compare_and_swap(&mutex->State, 0, 1);
+
+	if (state == 0)
+	{
+		return;
+	}
+	if (state != 2)
+	{
+		state = __sync_lock_test_and_set(&mutex->State, 2);
+	}
+	while (state != 0)
+	{
+		futex(&mutex->State, FUTEX_WAIT, 2);
+		state = __sync_lock_test_and_set(&mutex->State, 2);
+	}
+}
+
+void mutexUnlock(Mutex *mutex)
+{
+	if (__sync_fetch_and_sub(&mutex->State, 1) != 1)
+	{
+		mutex->State = 0;
+		futex(&mutex->State, FUTEX_WAKE, 1);
+	}
+}
@@ -3,87 +3,284 @@
 #include "user.h"
 #include "param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Segregated size-class memory allocator.
+//
+// Small requests (up to MAXSMALL bytes including the block header) are rounded
+// up to a power of two and served from a per-class free list, so malloc and
+// free are O(1) for them.  When a class runs dry, a slab of SLABSIZE bytes is
+// obtained from sbrk and carved into blocks of that class.
+//
+// Larger requests are given their own region of whole pages.  Freed large
+// regions are kept on an address-ordered list and coalesced with their
+// neighbours (as in the Kernighan and Ritchie allocator, The C Programming
+// Language, 2nd ed.  Section 8.7).  Whenever the highest free region ends at
+// the current program break, it is handed back to the kernel with a
+// negative sbrk.
+//
+// One mutex protects the whole allocator, so that threads can use it.
 
 typedef long Align;
 
 union header {
 	struct {
-		union header *ptr;
-		uint32_t size;
+		union header *ptr;		// Next block on a free list
+		uint32_t size;			// Size of the block in bytes, including this header
 	} s;
 	Align x;
 };
 
 typedef union header Header;
 
-static Header base;
-static Header *freep;
+#define PAGESIZE	4096
+#define MINSHIFT	4						// Smallest block is 16 bytes
+#define NCLASSES	8						// 16, 32, 64, ... 2048
+#define MAXSMALL	(1 << (MINSHIFT + NCLASSES - 1))
+#define SLABSIZE	(4 * PAGESIZE)
 
-void free(void *ap)
+static Header *smallFree[NCLASSES];
+static Header largeBase;
+static Header *largeFree;
+static Mutex mallocLock = MUTEX_INITIALISER;
+
+// Round n up to a multiple of the page size
+
+static uint32_t pageRoundUp(uint32_t n)
 {
-	Header *bp, *p;
+	return (n + PAGESIZE - 1) & ~(PAGESIZE - 1);
+}
 
-	bp = (Header*)ap - 1;
-	for (p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
+// Return the size class that holds a block of nbytes (header included)
+
+static int sizeClass(uint32_t nbytes)
+{
+	int c = 0;
+	uint32_t blockSize = 1 << MINSHIFT;
+
+	while (blockSize < nbytes)
+	{
+		blockSize <<= 1;
+		c++;
+	}
+	return c;
+}
+
+// Get n bytes of page-aligned memory from the kernel, or 0 on failure.
+// The first call pads the break out to a page boundary so that every
+// region we hand out afterwards is page aligned.
+
+static char* moreMemory(uint32_t n)
+{
+	static int aligned;
+	char *p;
+
+	if (!aligned)
+	{
+		p = sbrk(0);
+		if (p == (char*)-1)
+		{
+			return 0;
+		}
+		if ((uint32_t)p & (PAGESIZE - 1))
+		{
+			if (sbrk(PAGESIZE - ((uint32_t)p & (PAGESIZE - 1))) == (char*)-1)
+			{
+				return 0;
+			}
+		}
+		aligned = 1;
+	}
+	p = sbrk(n);
+	if (p == (char*)-1)
+	{
+		return 0;
+	}
+	return p;
+}
+
+// Carve a new slab into blocks of class c and put them on its free list
+
+static int refillClass(int c)
+{
+	uint32_t blockSize = 1 << (MINSHIFT + c);
+	char *slab;
+	char *p;
+	Header *hp;
+
+	slab = moreMemory(SLABSIZE);
+	if (slab == 0)
+	{
+		return -1;
+	}
+	for (p = slab + SLABSIZE - blockSize; p >= slab; p -= blockSize)
+	{
+		hp = (Header*)p;
+		hp->s.size = blockSize;
+		hp->s.ptr = smallFree[c];
+		smallFree[c] = hp;
+	}
+	return 0;
+}
+
+// Give the highest free large region back to the kernel if it sits at the
+// current program break.
+
+static void trimLarge(void)
+{
+	Header *p, *prevp;
+	char *brk;
+
+	if (largeFree == 0)
+	{
+		return;
+	}
+	brk = sbrk(0);
+	for (prevp = &largeBase, p = largeBase.s.ptr; p != &largeBase; prevp = p, p = p->s.ptr)
+	{
+		if ((char*)p + p->s.size == brk)
+		{
+			prevp->s.ptr = p->s.ptr;
+			largeFree = prevp;
+			sbrk(-(int)p->s.size);
+			return;
+		}
+	}
+}
+
+// Return a large block to the address-ordered free list, coalescing
+// with its neighbours.
+
+static void freeLarge(Header *bp)
+{
+	Header *p;
+
+	if (largeFree == 0)
+	{
+		largeBase.s.ptr = largeFree = &largeBase;
+		largeBase.s.size = 0;
+	}
+	for (p = largeFree; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
+	{
 		if (p >= p->s.ptr && (bp > p || bp < p->s.ptr))
+		{
 			break;
-	if (bp + bp->s.size == p->s.ptr) {
+		}
+	}
+	if ((char*)bp + bp->s.size == (char*)p->s.ptr)
+	{
 		bp->s.size += p->s.ptr->s.size;
 		bp->s.ptr = p->s.ptr->s.ptr;
 	}
 	else
+	{
 		bp->s.ptr = p->s.ptr;
-	if (p + p->s.size == bp) {
+	}
+	if (p != &largeBase && (char*)p + p->s.size == (char*)bp)
+	{
 		p->s.size += bp->s.size;
 		p->s.ptr = bp->s.ptr;
 	}
 	else
+	{
 		p->s.ptr = bp;
-	freep = p;
+	}
+	largeFree = p;
+	trimLarge();
 }
 
-static Header* morecore(uint32_t nu)
+// Allocate a large block of nbytes (header included, page rounded)
+
+static void* mallocLarge(uint32_t nbytes)
 {
-	char *p;
-	Header *hp;
+	Header *p, *prevp, *rest;
 
-	if (nu < 4096)
-		nu = 4096;
-	p = sbrk(nu * sizeof(Header));
-	if (p == (char*)-1)
+	nbytes = pageRoundUp(nbytes);
+	if (largeFree != 0)
+	{
+		prevp = largeFree;
+		for (p = prevp->s.ptr; ; prevp = p, p = p->s.ptr)
+		{
+			if (p->s.size >= nbytes)
+			{
+				if (p->s.size - nbytes > MAXSMALL)
+				{
+					// Split, keeping the low part on the free list
+					p->s.size -= nbytes;
+					rest = (Header*)((char*)p + p->s.size);
+					rest->s.size = nbytes;
+					p = rest;
+				}
+				else
+				{
+					prevp->s.ptr = p->s.ptr;
+				}
+				largeFree = prevp;
+				return (void*)(p + 1);
+			}
+			if (p == largeFree)
+			{
+				break;
+			}
+		}
+	}
+	p = (Header*)moreMemory(nbytes);
+	if (p == 0)
+	{
 		return 0;
-	hp = (Header*)p;
-	hp->s.size = nu;
-	free((void*)(hp + 1));
-	return freep;
+	}
+	p->s.size = nbytes;
+	return (void*)(p + 1);
+}
+
+void free(void *ap)
+{
+	Header *bp;
+	int c;
+
+	if (ap == 0)
+	{
+		return;
+	}
+	bp = (Header*)ap - 1;
+	mutexLock(&mallocLock);
+	if (bp->s.size <= MAXSMALL)
+	{
+		c = sizeClass(bp->s.size);
+		bp->s.ptr = smallFree[c];
+		smallFree[c] = bp;
+	}
+	else
+	{
+		freeLarge(bp);
+	}
+	mutexUnlock(&mallocLock);
 }
 
 void* malloc(uint32_t nbytes)
 {
-	Header *p, *prevp;
-	uint32_t nunits;
-
-	nunits = (nbytes + sizeof(Header) - 1) / sizeof(Header) + 1;
-	if ((prevp = freep) == 0) {
-		base.s.ptr = freep = prevp = &base;
-		base.s.size = 0;
-	}
-	for (p = prevp->s.ptr; ; prevp = p, p = p->s.ptr) {
-		if (p->s.size >= nunits) {
-			if (p->s.size == nunits)
-				prevp->s.ptr = p->s.ptr;
-			else {
-				p->s.size -= nunits;
-				p += p->s.size;
-				p->s.size = nunits;
-			}
-			freep = prevp;
-			return (void*)(p + 1);
-		}
-		if (p == freep)
-			if ((p = morecore(nunits)) == 0)
-				return 0;
+	Header *p;
+	uint32_t total;
+	int c;
+
+	total = nbytes + sizeof(Header);
+	if (total < nbytes)
+	{
+		return 0;
+	}
+	mutexLock(&mallocLock);
+	if (total > MAXSMALL)
+	{
+		p = mallocLarge(total);
+		mutexUnlock(&mallocLock);
+		return p;
+	}
+	c = sizeClass(total);
+	if (smallFree[c] == 0 && refillClass(c) < 0)
+	{
+		mutexUnlock(&mallocLock);
+		return 0;
 	}
+	p = smallFree[c];
+	smallFree[c] = p->s.ptr;
+	mutexUnlock(&mallocLock);
+	return (void*)(p + 1);
 }
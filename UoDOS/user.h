@@ -1,4 +1,25 @@
 struct _Stat;
+struct _Dirent;
+struct _PerfCounters;
+struct _Timespec;
+
+// A thread made by threadCreate.  Fill in nothing; threadCreate does it.
+typedef struct _Thread
+{
+	int					Id;				// Process ID of the thread
+	void *				Stack;			// Its stack, freed by threadJoin
+	void *				(*Function)(void *);
+	void *				Argument;
+	void *				Result;			// What Function returned
+} Thread;
+
+// A lock for threads.  Initialise to MUTEX_INITIALISER or with mutexInitialise.
+typedef struct _Mutex
+{
+	volatile int		State;			// 0 unlocked, 1 locked, 2 locked with threads waiting
+} Mutex;
+
+#define MUTEX_INITIALISER	{ 0 }
 
 // System calls.  If you add any new system calls to UoDOS, the signature of the calls for
 // user programs should be added here, as well as adding them to syscalls.pl.
@@ -26,6 +47,16 @@ int uptime(void);
 //stage 1 systems calls
 int chdir(char *directory);
 int getcwd(char *currentDirectory, int sizeOfBuffer);
+int getdents(int fd, struct _Dirent*, int count);
+int mkdir(char*);
+int unlink(char*);
+int ftruncate(int fd, uint32_t size);
+int getcounters(struct _PerfCounters*);
+int clone(void (*)(void*), void*, void*);
+int join(int);
+int futex(volatile int*, int, int);
+int nanosleep(struct _Timespec*);
+int clock_gettime(int, struct _Timespec*);
 
 // The following are C standard library functions implemented in our
 // equivalent of the C run-time library
@@ -42,6 +73,11 @@ void* memset(void*, int, uint32_t);
 void* malloc(uint32_t);
 void free(void*);
 int atoi(const char*);
+int threadCreate(Thread*, void* (*)(void*), void*);
+int threadJoin(Thread*, void**);
+void mutexInitialise(Mutex*);
+void mutexLock(Mutex*);
+void mutexUnlock(Mutex*);
 
 // printf.c
 void printf(char*, ...);
@@ -0,0 +1,611 @@
+// Virtual file system.
+//
+// The syscall layer (file.c, sysfile.c and exec.c) opens, reads and stats
+// files through the functions here rather than calling a particular file
+// system.  File systems are attached to the tree with vfsMount, which records
+// them in the mount table along with their FileSystemOperations vector.
+//
+// Every open file or directory refers to a vnode.  Vnodes live in a cache
+// shared by all mounted file systems and are identified by their mount and
+// an id chosen by the file system (for FAT, the first cluster).  A vnode
+// whose reference count drops to 0 stays in the cache, so opening the same
+// file again finds it, until its slot is needed for something else.
+//
+// Paths are made absolute using the current directory and "." and ".." are
+// resolved by name before the path is walked, so ".." works across mount
+// points.  Both '/' and '\' are accepted as separators.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "dirent.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "rwlock.h"
+#include "fs.h"
+#include "file.h"
+#include "vfs.h"
+
+// Every path lookup searches the mount table, and it only changes when a file
+// system is mounted, so it has a reader-writer lock and lookups on different
+// CPUs do not wait for each other.  A mount becomes visible when InUse is set
+// to 1, after it is filled in.
+
+struct
+{
+	ReadWriteLock	Lock;
+	Mount			Mount[NMOUNT];
+} mountTable;
+
+struct
+{
+	Spinlock		Lock;
+	Vnode			Vnode[NVNODE];
+} vnodeCache;
+
+void vfsInitialise(void)
+{
+	readWriteLockInitialise(&mountTable.Lock, "mountTable");
+	spinlockInitialise(&vnodeCache.Lock, "vnodeCache");
+}
+
+// Return a referenced vnode for id on mount.  If the vnode is not already in
+// the cache, a free slot is filled in from template, which the file system
+// sets up with everything except the reference count, mount and id.  Vnodes
+// with an id of VNODE_NOID are never shared.  Returns 0 if the cache is full.
+
+Vnode * vnodeGet(Mount * mount, uint32_t id, Vnode * template)
+{
+	Vnode * vnode;
+	Vnode * empty = 0;
+
+	spinlockAcquire(&vnodeCache.Lock);
+	for (vnode = vnodeCache.Vnode; vnode < &vnodeCache.Vnode[NVNODE]; vnode++)
+	{
+		if (id != VNODE_NOID && vnode->Mount == mount && vnode->Id == id)
+		{
+			vnode->ReferenceCount++;
+			spinlockRelease(&vnodeCache.Lock);
+			return vnode;
+		}
+		// Prefer a slot that has never been used over one holding a cached vnode
+		if (vnode->ReferenceCount == 0 && (empty == 0 || (empty->Mount != 0 && vnode->Mount == 0)))
+		{
+			empty = vnode;
+		}
+	}
+	if (empty == 0)
+	{
+		spinlockRelease(&vnodeCache.Lock);
+		cprintf("vnodeGet: no vnodes\n");
+		return 0;
+	}
+	memmove(empty, template, sizeof(Vnode));
+	empty->ReferenceCount = 1;
+	empty->Mount = mount;
+	empty->Id = id;
+	spinlockRelease(&vnodeCache.Lock);
+	return empty;
+}
+
+// Increment the reference count for a vnode
+
+Vnode * vnodeDup(Vnode * vnode)
+{
+	spinlockAcquire(&vnodeCache.Lock);
+	if (vnode->ReferenceCount < 1)
+	{
+		panic("vnodeDup");
+	}
+	vnode->ReferenceCount++;
+	spinlockRelease(&vnodeCache.Lock);
+	return vnode;
+}
+
+// Drop a reference to a vnode.  When the last reference goes, the file system's
+// Release operation (which must not sleep) is called and the vnode is removed
+// from the cache.  File systems without a Release operation leave it cached.
+
+void vnodePut(Vnode * vnode)
+{
+	spinlockAcquire(&vnodeCache.Lock);
+	if (vnode->ReferenceCount < 1)
+	{
+		panic("vnodePut");
+	}
+	if (--vnode->ReferenceCount == 0 && (vnode->Id == VNODE_NOID || vnode->Mount->Operations->Release))
+	{
+		if (vnode->Mount->Operations->Release)
+		{
+			vnode->Mount->Operations->Release(vnode);
+		}
+		vnode->Mount = 0;
+		vnode->Id = VNODE_NOID;
+	}
+	spinlockRelease(&vnodeCache.Lock);
+}
+
+// Mount a file system at path, which must be absolute and must not end in a
+// separator (other than "/" itself).  Returns 0 on success, -1 on failure.
+
+int vfsMount(const char * path, FileSystemOperations * operations, uint32_t device)
+{
+	Mount * mount;
+	Mount * empty = 0;
+
+	if (strlen(path) >= MAXMOUNTPATH)
+	{
+		return -1;
+	}
+	writeLockAcquire(&mountTable.Lock);
+	for (mount = mountTable.Mount; mount < &mountTable.Mount[NMOUNT]; mount++)
+	{
+		if (mount->InUse && strncmp(mount->Path, path, MAXMOUNTPATH) == 0)
+		{
+			writeLockRelease(&mountTable.Lock);
+			return -1;
+		}
+		if (!mount->InUse && empty == 0)
+		{
+			empty = mount;
+		}
+	}
+	if (empty == 0)
+	{
+		writeLockRelease(&mountTable.Lock);
+		return -1;
+	}
+	// Claim the slot, but do not make it visible to lookups until it is ready
+	memset(empty, 0, sizeof(Mount));
+	empty->InUse = -1;
+	writeLockRelease(&mountTable.Lock);
+
+	safestrcpy(empty->Path, path, MAXMOUNTPATH);
+	empty->Device = device;
+	empty->Operations = operations;
+	if (operations->Mount(empty) < 0 || empty->Root == 0)
+	{
+		writeLockAcquire(&mountTable.Lock);
+		empty->InUse = 0;
+		writeLockRelease(&mountTable.Lock);
+		return -1;
+	}
+	writeLockAcquire(&mountTable.Lock);
+	empty->InUse = 1;
+	writeLockRelease(&mountTable.Lock);
+	return 0;
+}
+
+// Find the file system that holds an absolute, canonical path.  That is the
+// mount with the longest path that is a prefix of it, ending at a separator.
+// *rest is set to the part of the path inside the file system.
+
+static Mount * vfsFindMount(const char * path, const char ** rest)
+{
+	Mount * mount;
+	Mount * best = 0;
+	int bestLength = -1;
+	int length;
+
+	readLockAcquire(&mountTable.Lock);
+	for (mount = mountTable.Mount; mount < &mountTable.Mount[NMOUNT]; mount++)
+	{
+		if (mount->InUse != 1)
+		{
+			continue;
+		}
+		length = strlen(mount->Path);
+		if (length == 1)
+		{
+			// The root mount matches everything
+			length = 0;
+		}
+		else if (strncmp(mount->Path, path, length) != 0 || (path[length] != 0 && path[length] != '/'))
+		{
+			continue;
+		}
+		if (length > bestLength)
+		{
+			best = mount;
+			bestLength = length;
+		}
+	}
+	readLockRelease(&mountTable.Lock);
+	if (best)
+	{
+		*rest = path + bestLength;
+	}
+	return best;
+}
+
+// Build the absolute path for filename relative to cwd in path, using '/' as
+// the separator and resolving "." and ".." components.  The result always
+// starts with '/' and has no trailing separator unless it is "/".  Returns 1
+// if filename ended with a separator (meaning it must name a directory), 0 if
+// not, or -1 if the path is too long.
+
+static int vfsCanonicalPath(const char * cwd, const char * filename, char * path)
+{
+	char full[MAXCWDSIZE * 2];
+	char * p;
+	char * part;
+	int length = 0;
+	int trailingSeparator = 0;
+	int cwdLength;
+
+	if (*filename == '\\' || *filename == '/')
+	{
+		cwdLength = 0;
+	}
+	else
+	{
+		cwdLength = strlen(cwd);
+		if (cwdLength >= MAXCWDSIZE)
+		{
+			return -1;
+		}
+		memmove(full, cwd, cwdLength);
+		full[cwdLength++] = '/';
+	}
+	if (cwdLength + strlen(filename) >= sizeof(full))
+	{
+		return -1;
+	}
+	safestrcpy(full + cwdLength, filename, sizeof(full) - cwdLength);
+	if (*filename)
+	{
+		char last = filename[strlen(filename) - 1];
+		trailingSeparator = (last == '/' || last == '\\');
+	}
+	p = full;
+	while (*p)
+	{
+		// Find the next component
+		while (*p == '/' || *p == '\\')
+		{
+			p++;
+		}
+		part = p;
+		while (*p && *p != '/' && *p != '\\')
+		{
+			p++;
+		}
+		if (*p)
+		{
+			*p++ = 0;
+		}
+		if (*part == 0 || strncmp(part, ".", 2) == 0)
+		{
+			continue;
+		}
+		if (strncmp(part, "..", 3) == 0)
+		{
+			// Remove the last component, if there is one
+			while (length > 0 && path[--length] != '/')
+			{
+			}
+			continue;
+		}
+		int partLength = strlen(part);
+		if (length + 1 + partLength >= MAXCWDSIZE)
+		{
+			return -1;
+		}
+		path[length++] = '/';
+		memmove(path + length, part, partLength);
+		length += partLength;
+	}
+	if (length == 0)
+	{
+		path[length++] = '/';
+	}
+	path[length] = 0;
+	return trailingSeparator;
+}
+
+// Walk an absolute, canonical path (which is modified while we work) and
+// return a referenced vnode for it, or 0.
+
+static Vnode * vfsWalk(char * path)
+{
+	const char * rest;
+	char * p;
+	char * part;
+	Mount * mount;
+	Vnode * vnode;
+	Vnode * next;
+
+	if ((mount = vfsFindMount(path, &rest)) == 0)
+	{
+		return 0;
+	}
+	vnode = vnodeDup(mount->Root);
+	p = (char *)rest;
+	while (*p)
+	{
+		// rest is empty, "/" or "/component/component..."
+		part = ++p;
+		if (*part == 0)
+		{
+			break;
+		}
+		while (*p && *p != '/')
+		{
+			p++;
+		}
+		char separator = *p;
+		*p = 0;
+		if (vnode->Type != T_DIR || mount->Operations->Lookup(vnode, part, &next) < 0)
+		{
+			vnodePut(vnode);
+			return 0;
+		}
+		vnodePut(vnode);
+		vnode = next;
+		*p = separator;
+	}
+	return vnode;
+}
+
+// Look up a path relative to cwd and return a referenced vnode for it, or 0.
+
+Vnode * vfsLookup(const char * cwd, const char * filename)
+{
+	char path[MAXCWDSIZE];
+	Vnode * vnode;
+	int mustBeDirectory;
+
+	if ((mustBeDirectory = vfsCanonicalPath(cwd, filename, path)) < 0)
+	{
+		return 0;
+	}
+	if ((vnode = vfsWalk(path)) == 0)
+	{
+		return 0;
+	}
+	if (mustBeDirectory && vnode->Type != T_DIR)
+	{
+		vnodePut(vnode);
+		return 0;
+	}
+	return vnode;
+}
+
+// Look up the directory that holds a path and return a referenced vnode for
+// it, copying the last component of the path into name.  Returns 0 if the
+// directory does not exist, or the path is "/" (which has no parent).
+
+static Vnode * vfsLookupParent(const char * cwd, const char * filename, char * name, int nameSize)
+{
+	char path[MAXCWDSIZE];
+	char * last;
+	Vnode * vnode;
+
+	if (vfsCanonicalPath(cwd, filename, path) < 0 || path[1] == 0)
+	{
+		return 0;
+	}
+	last = path + strlen(path);
+	while (*(last - 1) != '/')
+	{
+		last--;
+	}
+	if (strlen(last) >= nameSize)
+	{
+		return 0;
+	}
+	safestrcpy(name, last, nameSize);
+	if (last - 1 == path)
+	{
+		// The parent is the root directory
+		*last = 0;
+	}
+	else
+	{
+		*(last - 1) = 0;
+	}
+	if ((vnode = vfsWalk(path)) != 0 && vnode->Type != T_DIR)
+	{
+		vnodePut(vnode);
+		return 0;
+	}
+	return vnode;
+}
+
+// Allocate a file structure for a vnode.  The file takes over the caller's
+// reference to the vnode.
+
+static File * vfsOpenVnode(Vnode * vnode, const char * filename)
+{
+	File * file;
+
+	if ((file = allocateFileStructure()) == 0)
+	{
+		vnodePut(vnode);
+		return 0;
+	}
+	file->Type = vnode->Type == T_DIR ? FD_DIR : FD_FILE;
+	file->Vnode = vnode;
+	file->Position = 0;
+	safestrcpy(file->Name, filename, sizeof(file->Name));
+	return file;
+}
+
+// Open a file or directory.  If directory is 1, the path must name a directory.
+
+File * vfsOpen(const char * cwd, const char * filename, int directory)
+{
+	Vnode * vnode;
+
+	if ((vnode = vfsLookup(cwd, filename)) == 0)
+	{
+		return 0;
+	}
+	if (directory == 1 && vnode->Type != T_DIR)
+	{
+		vnodePut(vnode);
+		return 0;
+	}
+	return vfsOpenVnode(vnode, filename);
+}
+
+// Open a file, creating it if it does not exist.
+
+File * vfsCreate(const char * cwd, const char * filename)
+{
+	char name[DIRENTNAMESIZE];
+	Vnode * directory;
+	Vnode * vnode;
+	int result = -1;
+
+	if ((vnode = vfsLookup(cwd, filename)) != 0)
+	{
+		if (vnode->Type == T_DIR)
+		{
+			vnodePut(vnode);
+			return 0;
+		}
+		return vfsOpenVnode(vnode, filename);
+	}
+	if ((directory = vfsLookupParent(cwd, filename, name, sizeof(name))) == 0)
+	{
+		return 0;
+	}
+	if (directory->Mount->Operations->Create)
+	{
+		result = directory->Mount->Operations->Create(directory, name, T_FILE, &vnode);
+	}
+	vnodePut(directory);
+	if (result < 0)
+	{
+		return 0;
+	}
+	return vfsOpenVnode(vnode, filename);
+}
+
+// Create a directory
+
+int vfsMakeDirectory(const char * cwd, const char * filename)
+{
+	char name[DIRENTNAMESIZE];
+	Vnode * directory;
+	Vnode * vnode;
+	int result = -1;
+
+	if ((directory = vfsLookupParent(cwd, filename, name, sizeof(name))) == 0)
+	{
+		return -1;
+	}
+	if (directory->Mount->Operations->Create)
+	{
+		result = directory->Mount->Operations->Create(directory, name, T_DIR, &vnode);
+	}
+	vnodePut(directory);
+	if (result < 0)
+	{
+		return -1;
+	}
+	vnodePut(vnode);
+	return 0;
+}
+
+// Remove a file or an empty directory
+
+int vfsRemove(const char * cwd, const char * filename)
+{
+	char name[DIRENTNAMESIZE];
+	Vnode * directory;
+	int result = -1;
+
+	if ((directory = vfsLookupParent(cwd, filename, name, sizeof(name))) == 0)
+	{
+		return -1;
+	}
+	if (directory->Mount->Operations->Remove)
+	{
+		result = directory->Mount->Operations->Remove(directory, name);
+	}
+	vnodePut(directory);
+	return result;
+}
+
+// Set the size of an open file
+
+int vfsTruncate(File * file, uint32_t size)
+{
+	Vnode * vnode = file->Vnode;
+
+	if (vnode->Type != T_FILE || vnode->Mount->Operations->Truncate == 0)
+	{
+		return -1;
+	}
+	return vnode->Mount->Operations->Truncate(vnode, size);
+}
+
+// Read from the current position in a file
+
+int vfsRead(File * file, char * buffer, int length)
+{
+	Vnode * vnode = file->Vnode;
+	int result;
+
+	if (length < 0)
+	{
+		return -1;
+	}
+	result = vnode->Mount->Operations->Read(vnode, file->Position, buffer, length);
+	if (result > 0)
+	{
+		file->Position += result;
+	}
+	return result;
+}
+
+// Write at the current position in a file
+
+int vfsWrite(File * file, char * buffer, int length)
+{
+	Vnode * vnode = file->Vnode;
+	int result;
+
+	if (vnode->Mount->Operations->Write == 0 || length < 0)
+	{
+		return -1;
+	}
+	result = vnode->Mount->Operations->Write(vnode, file->Position, buffer, length);
+	if (result > 0)
+	{
+		file->Position += result;
+	}
+	return result;
+}
+
+// Read up to count entries from a directory, continuing from where the last
+// call stopped.
+
+int vfsReadDirectory(File * file, Dirent * dirents, int count)
+{
+	Vnode * vnode = file->Vnode;
+
+	if (vnode->Type != T_DIR || count < 0)
+	{
+		return -1;
+	}
+	return vnode->Mount->Operations->ReadDirectory(vnode, &file->Position, dirents, count);
+}
+
+int vfsStat(File * file, Stat * st)
+{
+	Vnode * vnode = file->Vnode;
+
+	memset(st, 0, sizeof(Stat));
+	return vnode->Mount->Operations->Stat(vnode, st);
+}
+
+// Called by fileClose when the last reference to a file has gone
+
+void vfsClose(File * file)
+{
+	vnodePut(file->Vnode);
+}
@@ -0,0 +1,71 @@
+// Virtual file system.
+//
+// Each mounted file system supplies a FileSystemOperations vector.  Files and
+// directories are represented in memory by vnodes, which are held in a cache
+// shared by all mounted file systems (see vfs.c).
+
+#define MAXMOUNTPATH	32		// Maximum length of a mount point path
+
+struct _FileSystemOperations
+{
+	char *	Name;
+
+	// Read the file system's superblock (or equivalent) and set Mount->Root.
+	int		(*Mount)(Mount *);
+
+	// Find name in the directory and return a referenced vnode for it.
+	int		(*Lookup)(Vnode *, const char *, Vnode **);
+
+	// Read up to n bytes from offset.  Returns the number of bytes read,
+	// 0 at the end of the file or -1 on error.
+	int		(*Read)(Vnode *, uint32_t, char *, uint32_t);
+
+	// Write n bytes at offset.  May be 0 for read-only file systems.
+	int		(*Write)(Vnode *, uint32_t, char *, uint32_t);
+
+	// Read up to count entries from a directory, starting at *position
+	// (which is updated).  Returns the number of entries read.
+	int		(*ReadDirectory)(Vnode *, uint32_t *, Dirent *, int);
+
+	// Fill in a Stat structure.
+	int		(*Stat)(Vnode *, Stat *);
+
+	// Called when the last reference to a vnode has gone.  May be 0.
+	void	(*Release)(Vnode *);
+
+	// Create a file (T_FILE) or directory (T_DIR) called name in a directory
+	// and return a referenced vnode for it.  May be 0 for read-only file systems.
+	int		(*Create)(Vnode *, const char *, short, Vnode **);
+
+	// Remove name from a directory.  Directories must be empty.  May be 0.
+	int		(*Remove)(Vnode *, const char *);
+
+	// Set the size of a file, discarding or zero filling.  May be 0.
+	int		(*Truncate)(Vnode *, uint32_t);
+};
+
+struct _Mount
+{
+	int							InUse;
+	char						Path[MAXMOUNTPATH];	// Where it is mounted, for example "/" or "/tmp"
+	uint32_t					Device;				// Disk device number, if the file system uses one
+	FileSystemOperations *		Operations;
+	Vnode *						Root;				// Root directory of the file system
+	void *						Private;			// File system specific mount data
+};
+
+#define VNODE_NOID		0xFFFFFFFF	// Id for a vnode that must not be shared
+
+struct _Vnode
+{
+	int						ReferenceCount;
+	Mount *					Mount;
+	uint32_t				Id;				// Unique within the mount (an inode number)
+	short					Type;			// T_FILE or T_DIR (see stat.h)
+	uint32_t				Size;			// Size of a file in bytes
+	union
+	{
+		FatNode				Fat;			// fs.c
+		TmpfsNode *			Tmpfs;			// tmpfs.c
+	} Data;
+};
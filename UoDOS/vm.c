@@ -5,11 +5,17 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "spinlock.h"
 #include "fs.h"
 #include "file.h"
+#include "traps.h"
+
+#define FREEBATCH	16			// Pages releaseUserPages unmaps before each TLB shootdown
 
 extern char data[];  			// defined by kernel.ld
 pde_t *kernelPageDirectory;  	// for use in Scheduler()
+static uint32_t globalPages;	// PTE_G if the CPU supports global pages, otherwise 0
+static int largePages;			// Does the CPU support 4 MiB pages?
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -92,6 +98,45 @@ static int createPageTableEntries(pde_t *pgdir, void *va, uint32_t size, uint32_
 	return 0;
 }
 
+// Map a region of the kernel's address space.  Where the virtual and
+// physical addresses are both 4 MiB aligned, a whole 4 MiB is mapped by
+// one page directory entry, which takes one TLB entry instead of 1024.
+// The rest is mapped with page tables.  size can take va up to 4 GiB.
+
+static int createKernelEntries(pde_t *pgdir, uint32_t va, uint32_t size, uint32_t pa, int perm)
+{
+	uint32_t step;
+
+	while (size > 0)
+	{
+		if (largePages && va % LARGEPGSIZE == 0 && pa % LARGEPGSIZE == 0 && size >= LARGEPGSIZE)
+		{
+			if (pgdir[PDX(va)] & PTE_P)
+			{
+				panic("remap");
+			}
+			pgdir[PDX(va)] = pa | perm | PTE_P | PTE_PS;
+			step = LARGEPGSIZE;
+		}
+		else
+		{
+			step = LARGEPGSIZE - va % LARGEPGSIZE;
+			if (step > size)
+			{
+				step = size;
+			}
+			if (createPageTableEntries(pgdir, (void*)va, step, pa, perm) < 0)
+			{
+				return -1;
+			}
+		}
+		va += step;
+		pa += step;
+		size -= step;
+	}
+	return 0;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kernelPageDirectory). The kernel uses the
 // current process's page table during system calls and interrupts;
@@ -114,7 +159,9 @@ static int createPageTableEntries(pde_t *pgdir, void *va, uint32_t size, uint32_
 // (directly addressable from end..P2V(PHYSTOP)).
 
 // This table defines the kernel's mappings, which are present in
-// every process's page table.
+// every process's page table.  They are the same in every page table, so
+// they are marked global where the CPU allows it and then stay in the TLB
+// when CR3 is loaded.  Only the user mappings are flushed by a switch.
 
 static struct kernelMemoryMap 
 {
@@ -130,51 +177,87 @@ static struct kernelMemoryMap
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Build kernelPageDirectory from kernelMemoryMap.  Done once, at boot.
 
-pde_t* setupKernelVirtualMemory(void)
+static void buildKernelPageDirectory(void)
 {
-	pde_t *pgdir;
 	struct kernelMemoryMap *k;
 
-	if ((pgdir = (pde_t*)allocatePhysicalMemoryPage()) == 0)
+	if ((kernelPageDirectory = (pde_t*)allocatePhysicalMemoryPage()) == 0)
 	{
-		return 0;
+		panic("buildKernelPageDirectory: out of memory");
 	}
-	memset(pgdir, 0, PGSIZE);
+	memset(kernelPageDirectory, 0, PGSIZE);
 	if (P2V(PHYSTOP) > (void*)DEVSPACE)
 	{
 		panic("PHYSTOP too high");
 	}
 	for (k = kernelMemoryMap; k < &kernelMemoryMap[NELEM(kernelMemoryMap)]; k++)
 	{
-		if (createPageTableEntries(pgdir, k->virt, k->phys_end - k->phys_start, (uint32_t)k->phys_start, k->perm) < 0)
+		if (createKernelEntries(kernelPageDirectory, (uint32_t)k->virt, k->phys_end - k->phys_start, (uint32_t)k->phys_start, k->perm | globalPages) < 0)
 		{
-			freeMemoryAndPageTable(pgdir);
-			return 0;
+			panic("buildKernelPageDirectory: out of memory");
 		}
 	}
+}
+
+// Set up kernel part of a page table.  The kernel half is the same in
+// every page directory, so its entries are copied from kernelPageDirectory
+// and the page tables they point to are shared rather than rebuilt.
+
+pde_t* setupKernelVirtualMemory(void)
+{
+	pde_t *pgdir;
+
+	if ((pgdir = (pde_t*)allocatePhysicalMemoryPage()) == 0)
+	{
+		return 0;
+	}
+	memset(pgdir, 0, PDX(KERNBASE) * sizeof(pde_t));
+	memmove(&pgdir[PDX(KERNBASE)], &kernelPageDirectory[PDX(KERNBASE)], (NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
 	return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for Scheduler processes.
+// space for Scheduler processes.  Runs before mpinit, so it cannot
+// use myCpu.
 
 void allocateKernelVirtualMemory(void)
 {
-	kernelPageDirectory = setupKernelVirtualMemory();
-	switchToKernelVirtualMemory();
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid(1, &eax, &ebx, &ecx, &edx);
+	if (edx & (1 << 13))
+	{
+		loadControlRegister4(readControlRegister4() | CR4_PGE);
+		globalPages = PTE_G;
+	}
+	if (edx & (1 << 3))
+	{
+		loadControlRegister4(readControlRegister4() | CR4_PSE);
+		largePages = 1;
+	}
+	buildKernelPageDirectory();
+	loadControlRegister3(V2P(kernelPageDirectory));   // switch to the kernel page table
 }
 
 // Switch h/w page table register to the kernel-only page table,
-// for when no process is running.
+// for when no process is running.  Does nothing if it is already loaded.
 
 void switchToKernelVirtualMemory(void)
 {
-	loadControlRegister3(V2P(kernelPageDirectory));   // switch to the kernel page table
+	pushCli();
+	if (myCpu()->PageTable != kernelPageDirectory)
+	{
+		myCpu()->PageTable = kernelPageDirectory;
+		loadControlRegister3(V2P(kernelPageDirectory));
+	}
+	popCli();
 }
 
-// Switch TSS and h/w page table to correspond to process p.
+// Switch TSS and h/w page table to correspond to process p.  CR3 is only
+// loaded if p's page table is not already loaded, for instance when the
+// CPU last ran another thread of the same process, so the TLB is kept.
 
 void switchToUserVirtualMemory(Process *p)
 {
@@ -199,7 +282,11 @@ void switchToUserVirtualMemory(Process *p)
 	// forbids I/O instructions (e.g., inb and outb) from user space
 	myCpu()->Taskstate.iomb = (uint16_t)0xFFFF;
 	loadTaskRegister(SEG_TSS << 3);
-	loadControlRegister3(V2P(p->PageTable));  // switch to process's address space
+	if (myCpu()->PageTable != p->PageTable)
+	{
+		myCpu()->PageTable = p->PageTable;
+		loadControlRegister3(V2P(p->PageTable));  // switch to process's address space
+	}
 	popCli();
 }
 
@@ -303,15 +390,88 @@ int allocateMemoryAndPageTables(pde_t *pgdir, uint32_t oldsz, uint32_t newsz)
 	return newsz;
 }
 
+// Make sure that no CPU still has TLB entries for user mappings just
+// removed from pgdir.  Only CPUs with pgdir loaded can have them: this
+// one is flushed directly and the others are sent an interrupt, and
+// this waits until they have flushed.  A CPU that loads pgdir later gets
+// a flushed TLB from loading CR3.  Must not hold a spinlock if another CPU
+// may have pgdir loaded, since that CPU might be spinning for the same
+// lock with interrupts off.
+
+void tlbShootdown(pde_t *pgdir)
+{
+	uint32_t waiting = 0;
+	int self;
+
+	__sync_synchronize();		// The page table changes before reading PageTable
+	pushCli();
+	self = cpuId();
+	if (cpus[self].PageTable == pgdir)
+	{
+		loadControlRegister3(V2P(pgdir));
+	}
+	for (int i = 0; i < ncpu; i++)
+	{
+		if (i != self && cpus[i].PageTable == pgdir)
+		{
+			if (cpus[self].CliDepth > 1)
+			{
+				panic("tlbShootdown locks");
+			}
+			cpus[i].TlbFlushPending = 1;
+			localApicSendInterrupt(cpus[i].Apicid, T_IRQ0 + IRQ_TLBFLUSH);
+			waiting |= 1 << i;
+		}
+	}
+	popCli();
+	for (int i = 0; i < ncpu; i++)
+	{
+		while ((waiting & (1 << i)) && cpus[i].TlbFlushPending)
+		{
+			cpuRelax();
+		}
+	}
+}
+
+// Flush this CPU's TLB when asked to by tlbShootdown
+
+void tlbFlushInterrupt(void)
+{
+	Cpu *c = myCpu();
+
+	loadControlRegister3(V2P(c->PageTable));
+	c->TlbFlushPending = 0;
+}
+
+// Free pages that have been unmapped from pgdir, once no CPU can
+// reach them through its TLB
+
+static void freeUnmappedPages(pde_t *pgdir, char **pages, int count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	tlbShootdown(pgdir);
+	for (int i = 0; i < count; i++)
+	{
+		freePhysicalMemoryPage(pages[i]);
+	}
+}
+
 // Deallocate user pages to bring the process size from oldsz to
 // newsz.  oldsz and newsz need not be page-aligned, nor does newsz
 // need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
+// process size.  Returns the new process size.  The pages are
+// unmapped in batches, and each batch is only freed after a TLB
+// shootdown, since other threads of the process may be running.
 
 int releaseUserPages(pde_t *pgdir, uint32_t oldsz, uint32_t newsz)
 {
 	pte_t *pte;
 	uint32_t a, pa;
+	char *batch[FREEBATCH];
+	int count = 0;
 
 	if (newsz >= oldsz)
 	{
@@ -332,16 +492,22 @@ int releaseUserPages(pde_t *pgdir, uint32_t oldsz, uint32_t newsz)
 			{
 				panic("freePhysicalMemoryPage");
 			}
-			char *v = P2V(pa);
-			freePhysicalMemoryPage(v);
 			*pte = 0;
+			batch[count++] = P2V(pa);
+			if (count == FREEBATCH)
+			{
+				freeUnmappedPages(pgdir, batch, count);
+				count = 0;
+			}
 		}
 	}
+	freeUnmappedPages(pgdir, batch, count);
 	return newsz;
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  No CPU may have it loaded.  The page
+// tables of the kernel part are shared, so they are kept.
 
 void freeMemoryAndPageTable(pde_t *pgdir)
 {
@@ -352,7 +518,7 @@ void freeMemoryAndPageTable(pde_t *pgdir)
 		panic("freeMemoryAndPageTable: no pgdir");
 	}
 	releaseUserPages(pgdir, KERNBASE, 0);
-	for (i = 0; i < NPDENTRIES; i++) 
+	for (i = 0; i < PDX(KERNBASE); i++) 
 	{
 		if (pgdir[i] & PTE_P) 
 		{
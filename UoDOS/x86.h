@@ -50,6 +50,55 @@ static inline void storeSequenceOfDwords(void *addr, int data, int cnt)
 		"memory", "cc");
 }
 
+static inline void moveSequenceOfBytes(void *dst, const void *src, int cnt)
+{
+	asm volatile("cld; rep movsb" :
+		"=D" (dst), "=S" (src), "=c" (cnt) :
+		"0" (dst), "1" (src), "2" (cnt) :
+		"memory", "cc");
+}
+
+static inline void moveSequenceOfDwords(void *dst, const void *src, int cnt)
+{
+	asm volatile("cld; rep movsl" :
+		"=D" (dst), "=S" (src), "=c" (cnt) :
+		"0" (dst), "1" (src), "2" (cnt) :
+		"memory", "cc");
+}
+
+// The backwards variants take the address of the last byte (or dword) of
+// each buffer and copy downwards.  The direction flag is cleared afterwards.
+
+static inline void moveSequenceOfBytesBackwards(void *dst, const void *src, int cnt)
+{
+	asm volatile("std; rep movsb; cld" :
+		"=D" (dst), "=S" (src), "=c" (cnt) :
+		"0" (dst), "1" (src), "2" (cnt) :
+		"memory", "cc");
+}
+
+static inline void moveSequenceOfDwordsBackwards(void *dst, const void *src, int cnt)
+{
+	asm volatile("std; rep movsl; cld" :
+		"=D" (dst), "=S" (src), "=c" (cnt) :
+		"0" (dst), "1" (src), "2" (cnt) :
+		"memory", "cc");
+}
+
+static inline void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+	asm volatile("cpuid" :
+		"=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx) :
+		"0" (leaf), "2" (0));
+}
+
+static inline uint64_t readTimeStampCounter(void)
+{
+	uint64_t tsc;
+	asm volatile("rdtsc" : "=A" (tsc));
+	return tsc;
+}
+
 struct Segdesc;
 
 static inline void loadGlobalDescriptorTable(struct Segdesc *p, int size)
@@ -115,6 +164,25 @@ static inline uint32_t atomicExchange(volatile uint32_t *addr, uint32_t newval)
 	return result;
 }
 
+// Atomically add value to *addr and return what *addr was before
+
+static inline uint16_t atomicFetchAndAddWord(volatile uint16_t *addr, uint16_t value)
+{
+	asm volatile("lock; xaddw %0, %1" :
+		"+r" (value), "+m" (*addr) :
+		:
+		"memory", "cc");
+	return value;
+}
+
+// Tell the processor that this is a spin-wait loop.  It then waits a little
+// before reading memory again and does not mis-speculate when the loop ends.
+
+static inline void cpuRelax(void)
+{
+	asm volatile("pause");
+}
+
 static inline uint32_t readControlRegister2(void)
 {
 	uint32_t val;
@@ -127,6 +195,18 @@ static inline void loadControlRegister3(uint32_t val)
 	asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint32_t readControlRegister4(void)
+{
+	uint32_t val;
+	asm volatile("movl %%cr4,%0" : "=r" (val));
+	return val;
+}
+
+static inline void loadControlRegister4(uint32_t val)
+{
+	asm volatile("movl %0,%%cr4" : : "r" (val));
+}
+
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().
 